@@ -0,0 +1,518 @@
+/**
+ * @file bench-csim.c
+ * @brief Measures the throughput of the cache simulator
+ *
+ * This program generates synthetic traces with different access patterns,
+ * runs the cache simulator (csim) on each of them for a matrix of cache
+ * geometries, and reports the throughput, peak memory use, and how the run
+ * time splits between parsing the trace and simulating the cache.
+ *
+ * The results are written as JSON, and can be compared against the JSON of
+ * an earlier build to catch performance regressions.
+ */
+
+#define _XOPEN_SOURCE 700 // mkdtemp, clock_gettime
+#define _DEFAULT_SOURCE   // wait4
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cachelab.h"
+
+#define MAX_STR 1024 /* Max string size */
+
+/** @brief Default number of accesses in each synthetic trace */
+#define DEFAULT_LENGTH 1000000
+
+/** @brief Default number of runs per measurement, the fastest one counts */
+#define DEFAULT_REPEAT 3
+
+/** @brief Default slowdown, in percent, reported as a regression */
+#define DEFAULT_THRESHOLD 10.0
+
+/** @brief Size of the region touched by the random and Zipfian patterns */
+#define REGION_SIZE (64UL << 20)
+
+/** @brief Number of distinct blocks drawn by the Zipfian pattern */
+#define ZIPF_BLOCKS (1 << 16)
+
+/** @brief Side of the double matrices walked by the transpose pattern */
+#define TRANS_N 1024
+
+/** @brief Base addresses of the synthetic data */
+#define BASE_A 0x10000000UL
+#define BASE_B 0x20000000UL
+
+/** @brief Number of access patterns */
+#define NUM_PATTERNS 5
+
+/** @brief Number of cache geometries */
+#define NUM_CACHES 4
+
+/** @brief Access patterns of the synthetic traces */
+static const char *const PATTERNS[NUM_PATTERNS] = {
+    "sequential", "strided", "random", "zipfian", "transpose",
+};
+
+typedef struct {
+    unsigned int s;
+    unsigned int E;
+    unsigned int b;
+} cache_geometry_t;
+
+/** @brief Cache geometries every trace is simulated on */
+static const cache_geometry_t CACHES[NUM_CACHES] = {
+    {.s = TEST_LOG_SET, .E = TEST_ASSOC, .b = TEST_LOG_BLOCK},
+    {.s = HASWELL_L1_SET, .E = HASWELL_L1_ASSOC, .b = HASWELL_L1_BLOCK},
+    {.s = 10, .E = 16, .b = 6},
+    {.s = 0, .E = 256, .b = 6},
+};
+
+/** @brief Measurements of one simulation */
+typedef struct {
+    const char *pattern;
+    cache_geometry_t cache;
+    unsigned long accesses;
+    double seconds;       /* wall time of the full simulation */
+    double parse_seconds; /* wall time of parsing the trace only */
+    long max_rss_kb;      /* peak resident set size of the simulator */
+} bench_result_t;
+
+/** @brief State of the xorshift64* generator used for the traces */
+static unsigned long rng_state = 0x9e3779b97f4a7c15UL;
+
+/**
+ * @brief Returns the next pseudo-random number
+ */
+static unsigned long next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dUL;
+}
+
+/**
+ * @brief Returns the current time in seconds
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * usage - Prints usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] [-n <accesses>] [-R <runs>] [-o <json>] "
+           "[-r <json>] [-t <percent>]\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -n <accesses> Accesses per synthetic trace (default %d)\n",
+           DEFAULT_LENGTH);
+    printf("  -R <runs>     Runs per measurement, the fastest counts "
+           "(default %d)\n",
+           DEFAULT_REPEAT);
+    printf("  -o <json>     Write the results to this file "
+           "(default bench-csim.json)\n");
+    printf("  -r <json>     Compare against the results of an earlier run\n");
+    printf("  -t <percent>  Slowdown reported as a regression (default %.0f)\n",
+           DEFAULT_THRESHOLD);
+}
+
+/**
+ * @brief Writes a synthetic trace with the given access pattern
+ *
+ * @param[in] file_name File to write the trace to
+ * @param[in] pattern   Index of the access pattern in PATTERNS
+ * @param[in] length    Number of accesses to generate
+ *
+ * @return false if any problems, true if OK.
+ */
+static bool generate_trace(const char *file_name, int pattern,
+                           unsigned long length) {
+    FILE *fp = fopen(file_name, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening '%s': %s\n", file_name,
+                strerror(errno));
+        return false;
+    }
+
+    /* Cumulative distribution of a Zipf(1) popularity over the blocks */
+    double *zipf_cdf = NULL;
+    if (strcmp(PATTERNS[pattern], "zipfian") == 0) {
+        zipf_cdf = malloc(ZIPF_BLOCKS * sizeof(double));
+        if (zipf_cdf == NULL) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            fclose(fp);
+            return false;
+        }
+        double total = 0.0;
+        for (int k = 0; k < ZIPF_BLOCKS; k++) {
+            total += 1.0 / (double)(k + 1);
+            zipf_cdf[k] = total;
+        }
+        for (int k = 0; k < ZIPF_BLOCKS; k++) {
+            zipf_cdf[k] /= total;
+        }
+    }
+
+    for (unsigned long i = 0; i < length; i++) {
+        char op = 'L';
+        unsigned long addr = BASE_A;
+
+        switch (pattern) {
+        case 0: /* sequential */
+            addr += 8 * i;
+            break;
+        case 1: /* strided: one access per page, then shift by a word */
+            addr += (i % 4096) * 4096 + (i / 4096) % 512 * 8;
+            break;
+        case 2: /* random */
+            addr += next_random() % REGION_SIZE & ~7UL;
+            op = (next_random() % 4 == 0) ? 'S' : 'L';
+            break;
+        case 3: { /* zipfian */
+            double u = (double)(next_random() >> 11) / (double)(1UL << 53);
+            int lo = 0;
+            int hi = ZIPF_BLOCKS - 1;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (zipf_cdf[mid] < u) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            /* Scatter popular blocks over the region */
+            unsigned long block = (unsigned long)lo * 2654435761UL;
+            addr += block * 64 % REGION_SIZE + next_random() % 8 * 8;
+            op = (next_random() % 4 == 0) ? 'S' : 'L';
+            break;
+        }
+        default: { /* transpose: load A[row][col], store B[col][row] */
+            unsigned long k = (i / 2) % (TRANS_N * TRANS_N);
+            unsigned long row = k / TRANS_N;
+            unsigned long col = k % TRANS_N;
+            if (i % 2 == 0) {
+                addr = BASE_A + (row * TRANS_N + col) * 8;
+            } else {
+                op = 'S';
+                addr = BASE_B + (col * TRANS_N + row) * 8;
+            }
+            break;
+        }
+        }
+
+        fprintf(fp, "%c %lx,8\n", op, addr);
+    }
+
+    free(zipf_cdf);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error writing '%s': %s\n", file_name,
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs the simulator once and measures it
+ *
+ * @param[in]  cache      Cache geometry to simulate
+ * @param[in]  trace      Trace file to simulate
+ * @param[in]  parse_only Whether to only parse the trace (csim -P)
+ * @param[out] seconds    Wall time of the run
+ * @param[out] max_rss_kb Peak resident set size of the run
+ *
+ * @return false if any problems, true if OK.
+ */
+static bool run_csim(const cache_geometry_t *cache, const char *trace,
+                     bool parse_only, double *seconds, long *max_rss_kb) {
+    char s[16], E[16], b[16];
+    snprintf(s, sizeof(s), "%u", cache->s);
+    snprintf(E, sizeof(E), "%u", cache->E);
+    snprintf(b, sizeof(b), "%u", cache->b);
+
+    fflush(stdout);
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error forking: %s\n", strerror(errno));
+        return false;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+        }
+        if (parse_only) {
+            execl("./csim", "./csim", "-P", "-s", s, "-E", E, "-b", b, "-t",
+                  trace, (char *)NULL);
+        } else {
+            execl("./csim", "./csim", "-s", s, "-E", E, "-b", b, "-t", trace,
+                  (char *)NULL);
+        }
+        fprintf(stderr, "Error running ./csim: %s\n", strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        fprintf(stderr, "Error waiting for csim: %s\n", strerror(errno));
+        return false;
+    }
+    *seconds = now() - start;
+    *max_rss_kb = usage.ru_maxrss;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error running csim on %s: Status %d\n", trace,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs the simulator several times and keeps the fastest run
+ *
+ * @return false if any problems, true if OK.
+ */
+static bool time_csim(const cache_geometry_t *cache, const char *trace,
+                      bool parse_only, int repeat, double *seconds,
+                      long *max_rss_kb) {
+    *seconds = HUGE_VAL;
+    *max_rss_kb = 0;
+    for (int i = 0; i < repeat; i++) {
+        double run_seconds;
+        long run_rss_kb;
+        if (!run_csim(cache, trace, parse_only, &run_seconds, &run_rss_kb)) {
+            return false;
+        }
+        *seconds = fmin(*seconds, run_seconds);
+        if (run_rss_kb > *max_rss_kb) {
+            *max_rss_kb = run_rss_kb;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the results as JSON, one result object per line
+ *
+ * @return false if any problems, true if OK.
+ */
+static bool write_json(const char *file_name, const bench_result_t *results,
+                       int nresults, unsigned long length) {
+    FILE *fp = fopen(file_name, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening '%s': %s\n", file_name,
+                strerror(errno));
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"accesses\": %lu,\n  \"results\": [\n", length);
+    for (int i = 0; i < nresults; i++) {
+        const bench_result_t *r = &results[i];
+        double ns = r->seconds * 1e9 / (double)r->accesses;
+        fprintf(fp,
+                "    {\"pattern\": \"%s\", \"s\": %u, \"E\": %u, \"b\": %u, "
+                "\"ns_per_access\": %.3f, \"accesses_per_second\": %.0f, "
+                "\"seconds\": %.6f, \"parse_seconds\": %.6f, "
+                "\"simulate_seconds\": %.6f, \"max_rss_kb\": %ld}%s\n",
+                r->pattern, r->cache.s, r->cache.E, r->cache.b, ns,
+                (double)r->accesses / r->seconds, r->seconds, r->parse_seconds,
+                fmax(r->seconds - r->parse_seconds, 0.0), r->max_rss_kb,
+                i + 1 < nresults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error writing '%s': %s\n", file_name,
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compares the results against the JSON written by an earlier run
+ *
+ * @return The number of regressions found, or -1 if the file is unreadable
+ */
+static int compare_json(const char *file_name, const bench_result_t *results,
+                        int nresults, double threshold) {
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening '%s': %s\n", file_name,
+                strerror(errno));
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[MAX_STR];
+    printf("\nComparison with %s:\n", file_name);
+    printf("%-12s%12s%12s%12s%10s\n", "Pattern", "( s,  E,b)", "Base ns",
+           "Now ns", "Change");
+
+    while (fgets(line, sizeof(line), fp)) {
+        char pattern[64];
+        cache_geometry_t cache;
+        double base_ns;
+        if (sscanf(line,
+                   " {\"pattern\": \"%63[^\"]\", \"s\": %u, \"E\": %u, "
+                   "\"b\": %u, \"ns_per_access\": %lf",
+                   pattern, &cache.s, &cache.E, &cache.b, &base_ns) != 5) {
+            continue;
+        }
+
+        for (int i = 0; i < nresults; i++) {
+            const bench_result_t *r = &results[i];
+            if (strcmp(r->pattern, pattern) != 0 || r->cache.s != cache.s ||
+                r->cache.E != cache.E || r->cache.b != cache.b) {
+                continue;
+            }
+            double ns = r->seconds * 1e9 / (double)r->accesses;
+            double change = (ns / base_ns - 1.0) * 100.0;
+            bool regressed = change > threshold;
+            char buf[MAX_STR];
+            sprintf(buf, "(%2u,%3u,%u)", cache.s, cache.E, cache.b);
+            printf("%-12s%12s%12.2f%12.2f%+9.1f%%%s\n", pattern, buf, base_ns,
+                   ns, change, regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        }
+    }
+
+    fclose(fp);
+    return regressions;
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    int c;
+    unsigned long length = DEFAULT_LENGTH;
+    int repeat = DEFAULT_REPEAT;
+    const char *json_file = "bench-csim.json";
+    const char *baseline_file = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+
+    /* Parse command line args */
+    while ((c = getopt(argc, argv, "hn:R:o:r:t:")) != -1) {
+        switch (c) {
+        case 'n':
+            length = strtoul(optarg, NULL, 10);
+            break;
+        case 'R':
+            repeat = atoi(optarg);
+            break;
+        case 'o':
+            json_file = optarg;
+            break;
+        case 'r':
+            baseline_file = optarg;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (length == 0 || repeat < 1) {
+        printf("Error: The number of accesses and runs must be positive\n");
+        usage(argv);
+        exit(1);
+    }
+
+    /* Keep traces and csim's result files out of the working directory */
+    char dir[] = "/tmp/bench-csim.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Error creating temporary directory: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+    char results_file[MAX_STR];
+    snprintf(results_file, sizeof(results_file), "%s/csim_results", dir);
+    setenv(CSIM_RESULTS_ENV, results_file, 1);
+
+    bench_result_t results[NUM_PATTERNS * NUM_CACHES];
+    int nresults = 0;
+    bool success = true;
+
+    printf("%-12s%12s%12s%14s%10s%10s%10s\n", "Pattern", "( s,  E,b)",
+           "ns/access", "accesses/s", "parse %", "sim %", "RSS KB");
+
+    for (int p = 0; p < NUM_PATTERNS && success; p++) {
+        char trace[MAX_STR];
+        snprintf(trace, sizeof(trace), "%s/%s.trace", dir, PATTERNS[p]);
+        if (!generate_trace(trace, p, length)) {
+            success = false;
+            break;
+        }
+
+        for (int i = 0; i < NUM_CACHES; i++) {
+            bench_result_t *r = &results[nresults];
+            long parse_rss_kb;
+            r->pattern = PATTERNS[p];
+            r->cache = CACHES[i];
+            r->accesses = length;
+
+            if (!time_csim(&CACHES[i], trace, true, repeat, &r->parse_seconds,
+                           &parse_rss_kb) ||
+                !time_csim(&CACHES[i], trace, false, repeat, &r->seconds,
+                           &r->max_rss_kb)) {
+                success = false;
+                break;
+            }
+            nresults++;
+
+            double parse_share = fmin(r->parse_seconds / r->seconds, 1.0);
+            char buf[MAX_STR];
+            sprintf(buf, "(%2u,%3u,%u)", r->cache.s, r->cache.E, r->cache.b);
+            printf("%-12s%12s%12.2f%14.0f%9.1f%%%9.1f%%%10ld\n", r->pattern,
+                   buf, r->seconds * 1e9 / (double)length,
+                   (double)length / r->seconds, parse_share * 100.0,
+                   (1.0 - parse_share) * 100.0, r->max_rss_kb);
+        }
+        (void)remove(trace);
+    }
+
+    (void)remove(results_file);
+    (void)rmdir(dir);
+
+    if (!success || !write_json(json_file, results, nresults, length)) {
+        exit(1);
+    }
+    printf("\nResults written to %s\n", json_file);
+
+    if (baseline_file != NULL) {
+        int regressions =
+            compare_json(baseline_file, results, nresults, threshold);
+        if (regressions != 0) {
+            exit(1);
+        }
+    }
+
+    exit(0);
+}
@@ -3,17 +3,34 @@
  * @brief Cache Lab helper functions
  */
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "cachelab.h"
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0;
 
+/**
+ * @brief Name of the file printSummary() stores the summary in.
+ *
+ * This is CSIM_RESULTS_FILE unless the CSIM_RESULTS environment variable
+ * names another file, which lets several simulations run concurrently.
+ */
+const char *summaryFileName(void) {
+    const char *file_name = getenv(CSIM_RESULTS_ENV);
+    if (file_name == NULL || file_name[0] == '\0') {
+        file_name = CSIM_RESULTS_FILE;
+    }
+    return file_name;
+}
+
 /**
  * @brief Store a summary of the cache simulation statistics.
  *
@@ -28,7 +45,7 @@ void printSummary(const csim_stats_t *stats) {
            stats->hits, stats->misses, stats->evictions, stats->dirty_bytes,
            stats->dirty_evictions);
 
-    FILE *output_fp = fopen(".csim_results", "w");
+    FILE *output_fp = fopen(summaryFileName(), "w");
     if (output_fp == NULL) {
         fprintf(stderr, "Error: failed to open results file: %s\n",
                 strerror(errno));
@@ -48,10 +65,22 @@ void printSummary(const csim_stats_t *stats) {
  * @return True if the operation was successful, false otherwise
  */
 bool loadSummary(csim_stats_t *stats) {
+    return loadSummaryFile(summaryFileName(), stats);
+}
+
+/**
+ * @brief Load a summary of the cache simulation statistics from a file.
+ *
+ * @param[in]  file_name The file written by printSummary()
+ * @param[out] stats     The simulation statistics that were read
+ *
+ * @return True if the operation was successful, false otherwise
+ */
+bool loadSummaryFile(const char *file_name, csim_stats_t *stats) {
     /* Get the results from the simulator */
-    FILE *fp = fopen(".csim_results", "r");
+    FILE *fp = fopen(file_name, "r");
     if (fp == NULL) {
-        fprintf(stderr, "Failed to open .csim_results: %s\n", strerror(errno));
+        fprintf(stderr, "Failed to open %s: %s\n", file_name, strerror(errno));
         return false;
     }
 
@@ -68,44 +97,410 @@ bool loadSummary(csim_stats_t *stats) {
 }
 
 /**
- * @brief Initialize the given matrices
+ * @brief Initialize an empty simulated cache
+ *
+ * @param[out] sim The simulator to initialize
+ * @param[in]  s   log2 of the number of sets
+ * @param[in]  E   associativity
+ * @param[in]  b   log2 of the block size
+ *
+ * @return True if the operation was successful, false otherwise
  */
-void initMatrix(size_t M, size_t N, double A[N][M], double B[M][N]) {
-    size_t i, j;
-    srand((unsigned int)time(NULL));
-    for (i = 0; i < N; i++) {
-        for (j = 0; j < M; j++) {
-            /* Initialize with data that can't be represented as int or float */
-            A[i][j] = (double)rand() / 8.0 + 1e10;
-            B[j][i] = (double)rand() / 8.0 + 1e10;
+bool cacheSimInit(cache_sim_t *sim, unsigned int s, unsigned int E,
+                  unsigned int b) {
+    memset(sim, 0, sizeof(*sim));
+    if (E == 0 || s + b > 63) {
+        fprintf(stderr, "Error: invalid cache geometry (s=%u, E=%u, b=%u)\n",
+                s, E, b);
+        return false;
+    }
+    sim->s = s;
+    sim->E = E;
+    sim->b = b;
+    sim->lines = calloc((size_t)E << s, sizeof(cache_sim_line_t));
+    if (sim->lines == NULL) {
+        fprintf(stderr, "Error: failed to allocate simulated cache\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Free the memory of a simulated cache
+ */
+void cacheSimFree(cache_sim_t *sim) {
+    free(sim->lines);
+    sim->lines = NULL;
+}
+
+/**
+ * @brief Simulate one memory access with LRU replacement and write-back
+ *
+ * @param[in,out] sim  The simulated cache
+ * @param[in]     op   'S' for a store, anything else is treated as a load
+ * @param[in]     addr The address accessed
+ */
+void cacheSimAccess(cache_sim_t *sim, char op, unsigned long addr) {
+    unsigned long block_size = 1UL << sim->b;
+    unsigned long set = (addr >> sim->b) & ((1UL << sim->s) - 1);
+    unsigned long tag = addr >> (sim->s + sim->b);
+    cache_sim_line_t *lines = &sim->lines[set * sim->E];
+    cache_sim_line_t *victim = NULL;
+
+    sim->timer++;
+    for (unsigned int i = 0; i < sim->E; i++) {
+        if (lines[i].valid && lines[i].tag == tag) {
+            sim->stats.hits++;
+            lines[i].time = sim->timer;
+            if (op == 'S' && !lines[i].dirty) {
+                lines[i].dirty = true;
+                sim->stats.dirty_bytes += block_size;
+            }
+            if (sim->event != NULL) {
+                memset(sim->event, 0, sizeof(*sim->event));
+                sim->event->address = addr;
+                sim->event->set = (uint32_t)set;
+                sim->event->way = (uint16_t)i;
+                sim->event->op = op;
+                sim->event->outcome = CSIM_EVENT_HIT;
+            }
+            return;
+        }
+        if (victim == NULL || (victim->valid && !lines[i].valid) ||
+            (victim->valid && lines[i].time < victim->time)) {
+            victim = &lines[i];
+        }
+    }
+
+    sim->stats.misses++;
+    if (sim->event != NULL) {
+        memset(sim->event, 0, sizeof(*sim->event));
+        sim->event->address = addr;
+        sim->event->set = (uint32_t)set;
+        sim->event->way = (uint16_t)(victim - lines);
+        sim->event->op = op;
+        sim->event->outcome =
+            victim->valid ? CSIM_EVENT_EVICTION : CSIM_EVENT_MISS;
+        if (victim->valid) {
+            sim->event->victim_tag = victim->tag;
+            sim->event->writeback = victim->dirty;
         }
     }
+    if (victim->valid) {
+        sim->stats.evictions++;
+        if (victim->dirty) {
+            sim->stats.dirty_evictions += block_size;
+            sim->stats.dirty_bytes -= block_size;
+            if (sim->dram != NULL) {
+                unsigned long victim_addr = ((victim->tag << sim->s) | set)
+                                            << sim->b;
+                dramSimAccess(sim->dram, victim_addr, true);
+            }
+        }
+    }
+    if (sim->dram != NULL) {
+        dramSimAccess(sim->dram, addr & ~(block_size - 1), false);
+    }
+    victim->valid = true;
+    victim->tag = tag;
+    victim->time = sim->timer;
+    victim->dirty = (op == 'S');
+    if (victim->dirty) {
+        sim->stats.dirty_bytes += block_size;
+    }
+}
+
+/**
+ * @brief Parse DRAM settings, leaving the others as they are
+ *
+ * The settings are a comma-separated list of banks=<n> (a power of two),
+ * row=<bytes> (a power of two), and cas=, rcd=, rp= and burst=<cycles>.
+ *
+ * @param[in,out] config The settings to update
+ * @param[in]     spec   The list of settings
+ *
+ * @return True if every setting was valid, false otherwise
+ */
+bool dramParseConfig(dram_config_t *config, const char *spec) {
+    while (*spec != '\0') {
+        char key[16];
+        unsigned long value;
+        int len;
+        if (sscanf(spec, "%15[a-z]=%lu%n", key, &value, &len) != 2) {
+            return false;
+        }
+        spec += len;
+        if (*spec == ',') {
+            spec++;
+        } else if (*spec != '\0') {
+            return false;
+        }
+
+        bool pow2 = value > 0 && (value & (value - 1)) == 0;
+        if (strcmp(key, "banks") == 0 && pow2) {
+            config->banks = (unsigned int)value;
+        } else if (strcmp(key, "row") == 0 && pow2) {
+            config->row_bits = 0;
+            while ((1UL << config->row_bits) < value) {
+                config->row_bits++;
+            }
+        } else if (strcmp(key, "cas") == 0) {
+            config->t_cas = value;
+        } else if (strcmp(key, "rcd") == 0) {
+            config->t_rcd = value;
+        } else if (strcmp(key, "rp") == 0) {
+            config->t_rp = value;
+        } else if (strcmp(key, "burst") == 0) {
+            config->t_burst = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Initialize a DRAM model with all banks closed
+ *
+ * @param[out] dram   The DRAM model to initialize
+ * @param[in]  config Its organization and timing
+ *
+ * @return True if the operation was successful, false otherwise
+ */
+bool dramSimInit(dram_sim_t *dram, const dram_config_t *config) {
+    memset(dram, 0, sizeof(*dram));
+    dram->config = *config;
+    dram->open_row = malloc(config->banks * sizeof(long));
+    if (dram->open_row == NULL) {
+        fprintf(stderr, "Error: failed to allocate DRAM banks\n");
+        return false;
+    }
+    for (unsigned int i = 0; i < config->banks; i++) {
+        dram->open_row[i] = -1;
+    }
+    return true;
+}
+
+/**
+ * @brief Free the memory of a DRAM model
+ */
+void dramSimFree(dram_sim_t *dram) {
+    free(dram->open_row);
+    dram->open_row = NULL;
+}
+
+/**
+ * @brief Read or write one block, charging the cycles of the access
+ *
+ * @param[in,out] dram  The DRAM model
+ * @param[in]     addr  Address of the block
+ * @param[in]     write True for a write-back, false for a read
+ */
+void dramSimAccess(dram_sim_t *dram, unsigned long addr, bool write) {
+    const dram_config_t *c = &dram->config;
+    unsigned long page = addr >> c->row_bits;
+    unsigned long bank = page & (c->banks - 1);
+    long row = (long)(page / c->banks);
+    unsigned long cycles = c->t_cas + c->t_burst;
+
+    if (dram->open_row[bank] == row) {
+        dram->row_hits++;
+    } else if (dram->open_row[bank] < 0) {
+        dram->row_empty++;
+        cycles += c->t_rcd;
+    } else {
+        dram->row_conflicts++;
+        cycles += c->t_rp + c->t_rcd;
+    }
+    dram->open_row[bank] = row;
+    dram->cycles += cycles;
+    if (write) {
+        dram->writes++;
+    } else {
+        dram->reads++;
+    }
+}
+
+/**
+ * @brief Simulate every access of a trace read from a stream
+ *
+ * Lines have the format produced by tracegen-ct: "<op> <hex addr>,<size>".
+ *
+ * @param[in,out] sim The simulated cache
+ * @param[in]     fp  The stream to read the trace from
+ *
+ * @return True if the whole trace was parsed, false otherwise
+ */
+bool cacheSimTrace(cache_sim_t *sim, FILE *fp) {
+    char line[256];
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *p = line;
+        char *end;
+
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            continue;
+        }
+
+        char op = *p++;
+        unsigned long addr = strtoul(p, &end, 16);
+        if (end == p || *end != ',') {
+            fprintf(stderr, "Error: malformed trace line\n");
+            return false;
+        }
+        p = end + 1;
+        (void)strtoul(p, &end, 10);
+        if (end == p) {
+            fprintf(stderr, "Error: malformed trace line\n");
+            return false;
+        }
+        while (isspace((unsigned char)*end)) {
+            end++;
+        }
+        if (*end != '\0') {
+            fprintf(stderr, "Error: malformed trace line\n");
+            return false;
+        }
+
+        if (op != 'L' && op != 'S') {
+            fprintf(stderr, "Error: invalid operation '%c' in trace\n", op);
+            return false;
+        }
+        cacheSimAccess(sim, op, addr);
+    }
+    return true;
+}
+
+/** @brief Side of the tiles the reference transposes work through */
+#define REF_TILE 16
+
+/**
+ * @brief Maps a counter to a pseudo-random value (SplitMix64)
+ *
+ * Being counter based, the values of all elements are independent, so
+ * filling a matrix is a loop the compiler can vectorize.
+ */
+static inline uint64_t mixCounter(uint64_t x) {
+    x += 0x9e3779b97f4a7c15u;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Fills n doubles with random data that can't be represented as int
+ *        or float, drawn from the counters seed, seed + 1, ...
+ */
+static void fillRandom(double *dst, size_t n, uint64_t seed) {
+    for (size_t k = 0; k < n; k++) {
+        /* 31 random bits, like rand() */
+        int32_t r = (int32_t)(mixCounter(seed + k) >> 33);
+        dst[k] = (double)r / 8.0 + 1e10;
+    }
+}
+
+/**
+ * @brief Initialize the given matrices
+ */
+void initMatrix(size_t M, size_t N, double A[N][M], double B[M][N]) {
+    uint64_t seed = mixCounter((uint64_t)time(NULL)) << 1;
+    fillRandom(&A[0][0], M * N, seed);
+    fillRandom(&B[0][0], M * N, seed + M * N);
 }
 
 /**
  * @brief Make a copy of a matrix
  */
 void copyMatrix(size_t M, size_t N, double Adst[N][M], double Asrc[N][M]) {
-    size_t i, j;
-    for (i = 0; i < N; i++)
-        for (j = 0; j < M; j++)
-            Adst[i][j] = Asrc[i][j];
+    memcpy(Adst, Asrc, M * N * sizeof(double));
 }
 
 /**
  * @brief baseline transpose function used to evaluate correctness
+ *
+ * Works through REF_TILE x REF_TILE tiles, so that large matrices transpose
+ * at memory speed instead of missing on every store to B.
  */
 void correctTrans(size_t M, size_t N, double A[N][M], double B[M][N]) {
-    size_t i, j;
-    double tmp;
-    for (i = 0; i < N; i++) {
-        for (j = 0; j < M; j++) {
-            tmp = A[i][j];
-            B[j][i] = tmp;
+    for (size_t ii = 0; ii < N; ii += REF_TILE) {
+        size_t iend = ii + REF_TILE < N ? ii + REF_TILE : N;
+        for (size_t jj = 0; jj < M; jj += REF_TILE) {
+            size_t jend = jj + REF_TILE < M ? jj + REF_TILE : M;
+            for (size_t i = ii; i < iend; i++) {
+                for (size_t j = jj; j < jend; j++) {
+                    B[j][i] = A[i][j];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Fill a matrix of elements of any size with distinct data
+ *
+ * The first four bytes of each element encode its index plus one, so no two
+ * elements are equal and none is zero, which is what B starts as.
+ */
+void initMatrixSized(size_t M, size_t N, size_t elem_size, void *A) {
+    unsigned char *bytes = A;
+    for (size_t k = 0; k < M * N; k++) {
+        for (size_t b = 0; b < elem_size; b++) {
+            unsigned long value = (k + 1) >> (8 * (b % 4));
+            bytes[k * elem_size + b] = (unsigned char)(value ^ (b * 0x9d));
         }
     }
 }
 
+/**
+ * @brief baseline transpose function for elements of any size
+ *
+ * Works through tiles like correctTrans().
+ */
+void correctTransSized(size_t M, size_t N, size_t elem_size, const void *A,
+                       void *B) {
+    const unsigned char *src = A;
+    unsigned char *dst = B;
+    for (size_t ii = 0; ii < N; ii += REF_TILE) {
+        size_t iend = ii + REF_TILE < N ? ii + REF_TILE : N;
+        for (size_t jj = 0; jj < M; jj += REF_TILE) {
+            size_t jend = jj + REF_TILE < M ? jj + REF_TILE : M;
+            for (size_t i = ii; i < iend; i++) {
+                for (size_t j = jj; j < jend; j++) {
+                    memcpy(&dst[(j * N + i) * elem_size],
+                           &src[(i * M + j) * elem_size], elem_size);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Number of threads parallel transpose functions should start
+ *
+ * This is the value of the TRANS_THREADS environment variable if it is set,
+ * and the number of online processors otherwise, capped at
+ * MAX_TRANS_THREADS.
+ */
+unsigned int transThreads(void) {
+    const char *env = getenv(TRANS_THREADS_ENV);
+    long nthreads = 0;
+    if (env != NULL && env[0] != '\0') {
+        nthreads = strtol(env, NULL, 10);
+    } else {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > MAX_TRANS_THREADS) {
+        nthreads = MAX_TRANS_THREADS;
+    }
+    return (unsigned int)nthreads;
+}
+
 /*
  * @brief Add the given trans function into your list of functions to be tested
  */
@@ -113,6 +508,199 @@ void registerTransFunction(void (*trans)(size_t M, size_t N, double[N][M],
                                          double[M][N], double *T),
                            const char *desc) {
     func_list[func_counter].func_ptr = trans;
+    func_list[func_counter].sized_ptr = NULL;
+    func_list[func_counter].elem_size = sizeof(double);
+    func_list[func_counter].description = desc;
+    func_counter++;
+}
+
+/**
+ * @brief Add a trans function for elements of elem_size bytes to the list
+ *
+ * Such a function gets A as N x M elements and B as M x N elements, both
+ * row-major, and tmp as TMPCOUNT * sizeof(double) bytes of scratch space.
+ */
+void registerSizedTransFunction(void (*trans)(size_t M, size_t N,
+                                              const void *A, void *B,
+                                              void *tmp),
+                                size_t elem_size, const char *desc) {
+    func_list[func_counter].func_ptr = NULL;
+    func_list[func_counter].sized_ptr = trans;
+    func_list[func_counter].elem_size = elem_size;
     func_list[func_counter].description = desc;
     func_counter++;
 }
+
+void (*tuned_func)(size_t M, size_t N, double[N][M], double[M][N], double *,
+                   size_t rows, size_t cols, tune_order_t order,
+                   tune_diag_t diag) = NULL;
+
+/**
+ * @brief Registers the tiled transpose tune-trans picks configurations for
+ *
+ * It is never scored on its own; tracegen-ct -C traces it with a given
+ * configuration, so that tune-trans can check the accesses it simulates.
+ */
+void registerTunedFunction(void (*trans)(size_t M, size_t N, double[N][M],
+                                         double[M][N], double *, size_t rows,
+                                         size_t cols, tune_order_t order,
+                                         tune_diag_t diag)) {
+    tuned_func = trans;
+}
+
+/**
+ * @brief Run registered trans function i, whatever its element size
+ */
+void runTransFunction(int i, size_t M, size_t N, void *A, void *B, void *tmp) {
+    if (func_list[i].sized_ptr != NULL) {
+        func_list[i].sized_ptr(M, N, A, B, tmp);
+    } else {
+        func_list[i].func_ptr(M, N, A, B, tmp);
+    }
+}
+
+kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+int kernel_counter = 0;
+
+/** @brief Names of the kernel families, indexed by kernel_family_t */
+static const char *const kernel_family_names[KERNEL_FAMILIES] = {
+    "gemm", "stencil", "row-sum", "col-sum", "gather", "scatter"};
+
+/**
+ * @brief Add a kernel of the given family to the list
+ */
+void registerKernel(kernel_family_t family, kernel_ptr_t kernel,
+                    const char *desc) {
+    kernel_list[kernel_counter].family = family;
+    kernel_list[kernel_counter].func_ptr = kernel;
+    kernel_list[kernel_counter].description = desc;
+    kernel_counter++;
+}
+
+/**
+ * @brief Name of a kernel family, as used in reports
+ */
+const char *kernelFamilyName(kernel_family_t family) {
+    return kernel_family_names[family];
+}
+
+/**
+ * @brief Sizes of the operands of a kernel of the family
+ */
+kernel_shape_t kernelShape(kernel_family_t family, size_t M, size_t N) {
+    kernel_shape_t shape = {M * N, 0, M * N};
+    switch (family) {
+    case KERNEL_GEMM:
+        shape.aux_bytes = M * N * sizeof(double);
+        shape.out_elems = N * N;
+        break;
+    case KERNEL_ROW_SUM:
+        shape.out_elems = N;
+        break;
+    case KERNEL_COL_SUM:
+        shape.out_elems = M;
+        break;
+    case KERNEL_GATHER:
+    case KERNEL_SCATTER:
+        shape.aux_bytes = M * N * sizeof(uint32_t);
+        break;
+    default:
+        break;
+    }
+    return shape;
+}
+
+/**
+ * @brief Fill n doubles with small random integers
+ *
+ * Sums and products of such values are exact, so a kernel may add them up
+ * in any order and still match kernelReference() bit for bit.
+ */
+static void fillSmall(double *dst, size_t n, uint64_t seed) {
+    for (size_t k = 0; k < n; k++) {
+        dst[k] = (double)(int32_t)(mixCounter(seed + k) & 15) - 7.0;
+    }
+}
+
+/**
+ * @brief Fill the input operands of a kernel of the family
+ *
+ * The indices of gather and scatter kernels are a random permutation.
+ */
+void kernelSetup(kernel_family_t family, size_t M, size_t N, double *in,
+                 void *aux) {
+    uint64_t seed = mixCounter((uint64_t)time(NULL)) << 1;
+    fillSmall(in, M * N, seed);
+
+    if (family == KERNEL_GEMM) {
+        fillSmall(aux, M * N, seed + M * N);
+    } else if (family == KERNEL_GATHER || family == KERNEL_SCATTER) {
+        uint32_t *idx = aux;
+        for (size_t k = 0; k < M * N; k++) {
+            idx[k] = (uint32_t)k;
+        }
+        for (size_t k = M * N; k > 1; k--) {
+            size_t r = (size_t)(mixCounter(seed + M * N + k) % k);
+            uint32_t t = idx[k - 1];
+            idx[k - 1] = idx[r];
+            idx[r] = t;
+        }
+    }
+}
+
+/**
+ * @brief baseline kernels used to evaluate correctness
+ */
+void kernelReference(kernel_family_t family, size_t M, size_t N,
+                     const double *in, const void *aux, double *out) {
+    const double *b = aux;
+    const uint32_t *idx = aux;
+    size_t i, j, k;
+
+    switch (family) {
+    case KERNEL_GEMM:
+        memset(out, 0, N * N * sizeof(double));
+        for (i = 0; i < N; i++)
+            for (k = 0; k < M; k++)
+                for (j = 0; j < N; j++)
+                    out[i * N + j] += in[i * M + k] * b[k * N + j];
+        break;
+    case KERNEL_STENCIL:
+        for (i = 0; i < N; i++) {
+            for (j = 0; j < M; j++) {
+                const double *c = &in[i * M + j];
+                if (i == 0 || j == 0 || i == N - 1 || j == M - 1) {
+                    out[i * M + j] = *c;
+                } else {
+                    out[i * M + j] =
+                        4 * c[0] - c[-1] - c[1] - c[-(long)M] - c[M];
+                }
+            }
+        }
+        break;
+    case KERNEL_ROW_SUM:
+        for (i = 0; i < N; i++) {
+            out[i] = 0;
+            for (j = 0; j < M; j++)
+                out[i] += in[i * M + j];
+        }
+        break;
+    case KERNEL_COL_SUM:
+        for (j = 0; j < M; j++) {
+            out[j] = 0;
+            for (i = 0; i < N; i++)
+                out[j] += in[i * M + j];
+        }
+        break;
+    case KERNEL_GATHER:
+        for (k = 0; k < M * N; k++)
+            out[k] = in[idx[k]];
+        break;
+    case KERNEL_SCATTER:
+        for (k = 0; k < M * N; k++)
+            out[idx[k]] = in[k];
+        break;
+    default:
+        break;
+    }
+}
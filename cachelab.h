@@ -7,6 +7,8 @@
 #define CACHELAB_TOOLS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 /**
@@ -22,12 +24,149 @@ typedef struct {
                                       from dirty lines */
 } csim_stats_t;
 
+/** @brief Default file storing the summary; csim-ref always uses this one */
+#define CSIM_RESULTS_FILE ".csim_results"
+
+/** @brief Environment variable selecting another file for the summary */
+#define CSIM_RESULTS_ENV "CSIM_RESULTS"
+
 /** @brief Store a summary of the cache simulation statistics. */
 void printSummary(const csim_stats_t *stats);
 
 /* @brief Load the stored summary of the cache simulation statistics. */
 bool loadSummary(csim_stats_t *stats);
 
+/** @brief Load a summary of the cache simulation statistics from a file. */
+bool loadSummaryFile(const char *file_name, csim_stats_t *stats);
+
+/** @brief Name of the file printSummary() stores the summary in. */
+const char *summaryFileName(void);
+
+/** @brief First bytes of an event log written by csim -e */
+#define CSIM_LOG_MAGIC "CSIMLOG1"
+
+/** @brief Outcome of an access in an event log */
+typedef enum {
+    CSIM_EVENT_HIT,     /* the block was in the cache */
+    CSIM_EVENT_MISS,    /* the block went into an empty line */
+    CSIM_EVENT_EVICTION /* the block replaced another one */
+} csim_outcome_t;
+
+/**
+ * @brief Start of an event log, followed by one csim_event_t per access
+ */
+typedef struct {
+    char magic[8]; /* CSIM_LOG_MAGIC */
+    uint32_t s;    /* log2 of the number of sets */
+    uint32_t E;    /* associativity */
+    uint32_t b;    /* log2 of the block size */
+    uint32_t x;    /* set index function of csim -x, 0 for bits */
+} csim_log_header_t;
+
+/**
+ * @brief Record of one simulated access in an event log
+ *
+ * Records have a fixed size and no implicit padding, so logs can be
+ * compared byte by byte.
+ */
+typedef struct {
+    uint64_t address;    /* address of the access */
+    uint64_t victim_tag; /* tag of the evicted block, 0 unless evicted */
+    uint32_t set;        /* set of the line accessed */
+    uint16_t way;        /* way of the line in its set */
+    char op;             /* 'L' or 'S' */
+    uint8_t outcome;     /* csim_outcome_t */
+    uint8_t writeback;   /* 1 if the evicted block was dirty */
+    uint8_t pad[7];      /* zero */
+} csim_event_t;
+
+/**
+ * @brief Timing and organization of the DRAM behind a simulated cache
+ *
+ * Addresses are interleaved over the banks row by row. Each bank keeps its
+ * last row open: an access to it costs t_cas, an access to a closed bank
+ * also t_rcd to open the row, and an access to another row also t_rp to
+ * close the open one. Every access then transfers its block in t_burst.
+ * All times are in CPU clock cycles, like HIT_CYCLES.
+ */
+typedef struct {
+    unsigned int banks;    /* number of banks, a power of two */
+    unsigned int row_bits; /* log2 of the bytes of a row of a bank */
+    unsigned long t_cas;   /* column access to the open row */
+    unsigned long t_rcd;   /* activation of a row in a closed bank */
+    unsigned long t_rp;    /* precharge, closing the open row */
+    unsigned long t_burst; /* transfer of one block */
+} dram_config_t;
+
+/** @brief DRAM of 8 banks of 8 KB rows, with DDR3-like timing at 3 GHz */
+#define DRAM_DEFAULT_CONFIG {8, 13, 40, 40, 40, 10}
+
+/**
+ * @brief State and statistics of the DRAM model
+ */
+typedef struct {
+    dram_config_t config;        /* organization and timing */
+    long *open_row;              /* open row of each bank, -1 if closed */
+    unsigned long row_hits;      /* accesses to the open row of their bank */
+    unsigned long row_empty;     /* accesses to a closed bank */
+    unsigned long row_conflicts; /* accesses to another row of a bank */
+    unsigned long reads;         /* blocks read, one per cache miss */
+    unsigned long writes;        /* blocks written back by dirty evictions */
+    unsigned long cycles;        /* total cycles of all the accesses */
+} dram_sim_t;
+
+/** @brief Parses DRAM settings like "banks=16,row=4096,cas=30" */
+bool dramParseConfig(dram_config_t *config, const char *spec);
+
+/** @brief Initializes a DRAM model with all banks closed */
+bool dramSimInit(dram_sim_t *dram, const dram_config_t *config);
+
+/** @brief Frees the memory of a DRAM model */
+void dramSimFree(dram_sim_t *dram);
+
+/** @brief Reads or writes the block at addr, charging its cycles */
+void dramSimAccess(dram_sim_t *dram, unsigned long addr, bool write);
+
+/**
+ * @brief One line of the in-process cache simulator
+ */
+typedef struct {
+    unsigned long tag;  /* tag of the cached block */
+    unsigned long time; /* LRU timestamp of the last access */
+    bool valid;         /* true if the line holds a block */
+    bool dirty;         /* true if the block was written */
+} cache_sim_line_t;
+
+/**
+ * @brief In-process LRU write-back cache simulator
+ *
+ * Behaves like csim-ref, so tools can simulate accesses as they are produced
+ * instead of going through a trace file.
+ */
+typedef struct {
+    unsigned int s;             /* log2 of the number of sets */
+    unsigned int E;             /* associativity */
+    unsigned int b;             /* log2 of the block size */
+    cache_sim_line_t *lines;    /* (1 << s) sets of E lines each */
+    unsigned long timer;        /* global LRU counter */
+    csim_stats_t stats;         /* statistics accumulated so far */
+    dram_sim_t *dram;           /* DRAM behind the cache, or NULL */
+    csim_event_t *event;        /* filled in by every access, or NULL */
+} cache_sim_t;
+
+/** @brief Initializes an empty simulated cache */
+bool cacheSimInit(cache_sim_t *sim, unsigned int s, unsigned int E,
+                  unsigned int b);
+
+/** @brief Frees the memory of a simulated cache */
+void cacheSimFree(cache_sim_t *sim);
+
+/** @brief Simulates one load ('L') or store ('S') */
+void cacheSimAccess(cache_sim_t *sim, char op, unsigned long addr);
+
+/** @brief Simulates every access of a trace read from a stream */
+bool cacheSimTrace(cache_sim_t *sim, FILE *fp);
+
 /* Grading parameters for transpose */
 
 /** @brief Number of clock cycles for hit */
@@ -61,6 +200,12 @@ bool loadSummary(csim_stats_t *stats);
            student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
+/** @brief Maximum number of threads of a parallel transpose function */
+#define MAX_TRANS_THREADS 64
+
+/** @brief Environment variable setting the number of transpose threads */
+#define TRANS_THREADS_ENV "TRANS_THREADS"
+
 /** @brief Maximum value of M or N in transpose functions */
 #define MAXN 4096
 
@@ -76,6 +221,9 @@ bool loadSummary(csim_stats_t *stats);
  */
 typedef struct trans_func {
     void (*func_ptr)(size_t M, size_t N, double[N][M], double[M][N], double *);
+    /* Transpose of elements of any size, used instead of func_ptr if set */
+    void (*sized_ptr)(size_t M, size_t N, const void *A, void *B, void *tmp);
+    size_t elem_size; /* bytes per element */
     const char *description;
 } trans_func_t;
 
@@ -95,9 +243,133 @@ void copyMatrix(size_t M, size_t N, double Adst[N][M], double Asrc[N][M]);
 /** @brief The baseline trans function that produces correct results. */
 void correctTrans(size_t M, size_t N, double A[N][M], double B[M][N]);
 
+/** @brief Fills a matrix of elements of any size with distinct data */
+void initMatrixSized(size_t M, size_t N, size_t elem_size, void *A);
+
+/** @brief The baseline trans function for elements of any size. */
+void correctTransSized(size_t M, size_t N, size_t elem_size, const void *A,
+                       void *B);
+
+/** @brief Adds a transpose function for elements of elem_size bytes */
+void registerSizedTransFunction(void (*trans)(size_t M, size_t N,
+                                              const void *A, void *B,
+                                              void *tmp),
+                                size_t elem_size, const char *desc);
+
+/** @brief Runs registered transpose function i, whatever its element size */
+void runTransFunction(int i, size_t M, size_t N, void *A, void *B, void *tmp);
+
+/** @brief Number of threads parallel transpose functions should start */
+unsigned int transThreads(void);
+
 /** @brief Adds a transpose function to the function list */
 void registerTransFunction(void (*trans)(size_t M, size_t N, double[N][M],
                                          double[M][N], double *),
                            const char *desc);
 
+/* Transpose tile configurations picked by tune-trans */
+
+/** @brief Order in which the elements of a tile are visited */
+typedef enum {
+    TUNE_ORDER_ROWS, /* along the rows of A, i.e. down the columns of B */
+    TUNE_ORDER_COLS  /* along the columns of A, i.e. the rows of B */
+} tune_order_t;
+
+/** @brief Handling of the tiles that cross the diagonal */
+typedef enum {
+    TUNE_DIAG_NONE,  /* transposed like any other tile */
+    TUNE_DIAG_DEFER, /* each diagonal element is copied last in its line */
+    TUNE_DIAG_BUFFER /* each row of A is copied through tmp first */
+} tune_diag_t;
+
+/**
+ * @brief Shape and strategy of a tiled transpose
+ *
+ * A configuration with zero rows stands for "not tuned".
+ */
+typedef struct {
+    size_t rows; /* rows of A per tile */
+    size_t cols; /* columns of A per tile, at most TMPCOUNT */
+    tune_order_t order;
+    tune_diag_t diag;
+} tune_config_t;
+
+/* trans_tuned() of trans.c, which tracegen-ct runs on its own with -C */
+extern void (*tuned_func)(size_t M, size_t N, double[N][M], double[M][N],
+                          double *, size_t rows, size_t cols,
+                          tune_order_t order, tune_diag_t diag);
+
+/** @brief Registers the tiled transpose tune-trans picks configurations for */
+void registerTunedFunction(void (*trans)(size_t M, size_t N, double[N][M],
+                                         double[M][N], double *, size_t rows,
+                                         size_t cols, tune_order_t order,
+                                         tune_diag_t diag));
+
+/* Kernels other than transpose, registered by kernels.c */
+
+/** @brief Maximum number of kernels that can be registered */
+#define MAX_KERNEL_FUNCS 100
+
+/**
+ * @brief Families of kernels, which differ in their operands
+ *
+ * Every kernel reads an input matrix in[N][M]. The other operands are:
+ */
+typedef enum {
+    KERNEL_GEMM,    /* aux is a double[M][N], out[N][N] = in * aux */
+    KERNEL_STENCIL, /* out[N][M] = 4 * in - its 4 neighbours, edges copied */
+    KERNEL_ROW_SUM, /* out[N] = the sums of the rows of in */
+    KERNEL_COL_SUM, /* out[M] = the sums of the columns of in */
+    KERNEL_GATHER,  /* aux is a uint32_t[M * N], out[k] = in[aux[k]] */
+    KERNEL_SCATTER, /* aux is a uint32_t[M * N], out[aux[k]] = in[k] */
+    KERNEL_FAMILIES
+} kernel_family_t;
+
+/** @brief A kernel of any family, see kernel_family_t for its operands */
+typedef void (*kernel_ptr_t)(size_t M, size_t N, const double *in,
+                             const void *aux, double *out);
+
+/**
+ * @brief Struct representing a registered kernel
+ */
+typedef struct {
+    kernel_family_t family;
+    kernel_ptr_t func_ptr;
+    const char *description;
+} kernel_func_t;
+
+/**
+ * @brief Sizes of the operands of a kernel
+ */
+typedef struct {
+    size_t in_elems;  /* doubles of in */
+    size_t aux_bytes; /* bytes of aux, 0 if the family has none */
+    size_t out_elems; /* doubles of out */
+} kernel_shape_t;
+
+/* External variables defined in cachelab.c */
+extern kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+extern int kernel_counter;
+
+/* External function defined in kernels.c */
+extern void registerKernels(void);
+
+/** @brief Adds a kernel of the given family to the kernel list */
+void registerKernel(kernel_family_t family, kernel_ptr_t kernel,
+                    const char *desc);
+
+/** @brief Name of a kernel family */
+const char *kernelFamilyName(kernel_family_t family);
+
+/** @brief Sizes of the operands of a kernel of the family */
+kernel_shape_t kernelShape(kernel_family_t family, size_t M, size_t N);
+
+/** @brief Fills the input operands of a kernel of the family */
+void kernelSetup(kernel_family_t family, size_t M, size_t N, double *in,
+                 void *aux);
+
+/** @brief The baseline kernel of the family, which produces correct results */
+void kernelReference(kernel_family_t family, size_t M, size_t N,
+                     const double *in, const void *aux, double *out);
+
 #endif /* CACHELAB_TOOLS_H */
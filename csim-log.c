@@ -0,0 +1,273 @@
+/**
+ * @file csim-log.c
+ * @brief Prints and compares the event logs written by csim -e
+ *
+ * With one log, the records are printed as text, one access per line. With
+ * two logs, or a log and the trace it came from (-t), the records are
+ * compared and the first access on which they diverge is reported. A trace
+ * is replayed on the in-process simulator of cachelab.c, which behaves like
+ * csim-ref, with the cache geometry stored in the log. That simulator only
+ * indexes sets with the address bits, so logs of csim -x cannot use -t.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+/** @brief Names of the outcomes, in csim_outcome_t order */
+static const char *outcome_names[] = {"hit", "miss", "eviction"};
+
+/** @brief Names of the set index functions, in the order of csim -x */
+static const char *index_names[] = {"bits", "xor", "prime", "skew"};
+#define NUM_INDEX (sizeof(index_names) / sizeof(index_names[0]))
+
+/**
+ * @brief Returns the name of the set index function of a log
+ */
+static const char *index_name(const csim_log_header_t *header) {
+    return header->x < NUM_INDEX ? index_names[header->x] : "?";
+}
+
+/** @brief A source of events: a log file or a trace replayed in-process */
+typedef struct {
+    const char *name;         /* file name for messages */
+    FILE *fp;                 /* log or trace being read */
+    csim_log_header_t header; /* geometry of the cache */
+    cache_sim_t *sim;         /* simulator replaying a trace, or NULL */
+} event_source_t;
+
+/**
+ * @brief Opens a log and reads its header
+ *
+ * @param[out] src  The source to open
+ * @param[in]  name File name of the log
+ *
+ * @return True if the log was opened, and false otherwise
+ */
+static bool open_log(event_source_t *src, const char *name) {
+    src->name = name;
+    src->sim = NULL;
+    src->fp = fopen(name, "rb");
+    if (src->fp == NULL) {
+        printf("Failed to open %s: %s\n", name, strerror(errno));
+        return false;
+    }
+    if (fread(&src->header, sizeof(src->header), 1, src->fp) != 1 ||
+        memcmp(src->header.magic, CSIM_LOG_MAGIC,
+               sizeof(src->header.magic)) != 0) {
+        printf("Error: %s is not a csim event log\n", name);
+        fclose(src->fp);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the next event of a source
+ *
+ * @param[in,out] src   The source to read from
+ * @param[out]    event The next event
+ * @param[out]    error Set to true if the source is malformed
+ *
+ * @return True if there was an event, and false at the end of the source
+ */
+static bool next_event(event_source_t *src, csim_event_t *event,
+                       bool *error) {
+    if (src->sim == NULL) {
+        size_t n = fread(event, 1, sizeof(*event), src->fp);
+        if (n != 0 && n != sizeof(*event)) {
+            printf("Error: %s ends with a partial record\n", src->name);
+            *error = true;
+        }
+        return n == sizeof(*event);
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), src->fp) != NULL) {
+        char *p = line;
+        char *end;
+        while (*p == ' ') {
+            p++;
+        }
+        if (*p == '\n' || *p == '\0') {
+            continue;
+        }
+        char op = *p++;
+        unsigned long addr = strtoul(p, &end, 16);
+        if ((op != 'L' && op != 'S') || end == p || *end != ',') {
+            printf("Error: malformed line in %s: %s", src->name, line);
+            *error = true;
+            return false;
+        }
+        src->sim->event = event;
+        cacheSimAccess(src->sim, op, addr);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Prints one event as text
+ *
+ * @param[in] label Prefix of the line
+ * @param[in] index Index of the access in the log
+ * @param[in] e     The event to print
+ */
+static void print_event(const char *label, unsigned long index,
+                        const csim_event_t *e) {
+    const char *outcome =
+        e->outcome <= CSIM_EVENT_EVICTION ? outcome_names[e->outcome] : "?";
+    printf("%s%lu %c %llx set:%u way:%u %s", label, index, e->op,
+           (unsigned long long)e->address, e->set, e->way, outcome);
+    if (e->outcome == CSIM_EVENT_EVICTION) {
+        printf(" victim_tag:%llx%s", (unsigned long long)e->victim_tag,
+               e->writeback ? " writeback" : "");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Prints every event of a log
+ *
+ * @return True if the whole log was read, and false otherwise
+ */
+static bool dump_log(event_source_t *src) {
+    csim_event_t e;
+    bool error = false;
+    printf("# s=%u E=%u b=%u x=%s\n", src->header.s, src->header.E,
+           src->header.b, index_name(&src->header));
+    for (unsigned long i = 0; next_event(src, &e, &error); i++) {
+        print_event("", i, &e);
+    }
+    return !error;
+}
+
+/**
+ * @brief Compares two sources, reporting the first divergence
+ *
+ * @return True if they hold the same events, and false otherwise
+ */
+static bool diff_sources(event_source_t *a, event_source_t *b) {
+    if (a->header.s != b->header.s || a->header.E != b->header.E ||
+        a->header.b != b->header.b || a->header.x != b->header.x) {
+        printf("Caches differ: %s has s=%u E=%u b=%u x=%s, %s has s=%u E=%u "
+               "b=%u x=%s\n",
+               a->name, a->header.s, a->header.E, a->header.b,
+               index_name(&a->header), b->name, b->header.s, b->header.E,
+               b->header.b, index_name(&b->header));
+        return false;
+    }
+
+    bool error = false;
+    for (unsigned long i = 0;; i++) {
+        csim_event_t ea;
+        csim_event_t eb;
+        bool more_a = next_event(a, &ea, &error);
+        bool more_b = next_event(b, &eb, &error);
+        if (error) {
+            return false;
+        }
+        if (!more_a && !more_b) {
+            printf("No divergence in %lu accesses\n", i);
+            return true;
+        }
+        if (!more_a || !more_b) {
+            printf("%s ends after %lu accesses, %s goes on\n",
+                   more_a ? b->name : a->name, i, more_a ? a->name : b->name);
+            return false;
+        }
+        if (memcmp(&ea, &eb, sizeof(ea)) != 0) {
+            printf("First divergence at access %lu:\n", i);
+            print_event("< ", i, &ea);
+            print_event("> ", i, &eb);
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] <log> [<log> | -t <trace>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -t <trace>  Compare the log with the reference simulation of "
+           "trace\n");
+    printf("With one log, print its records; with two, compare them.\n");
+    printf("Example: %s -t traces/csim/yi.trace yi.log\n", argv[0]);
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    int c;
+    const char *trace = NULL;
+
+    while ((c = getopt(argc, argv, "ht:")) != -1) {
+        switch (c) {
+        case 't':
+            trace = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    int nlogs = argc - optind;
+    if (nlogs < 1 || nlogs > 2 || (trace != NULL && nlogs != 1)) {
+        usage(argv);
+        exit(1);
+    }
+
+    event_source_t a;
+    if (!open_log(&a, argv[optind])) {
+        exit(1);
+    }
+    if (nlogs == 1 && trace == NULL) {
+        bool ok = dump_log(&a);
+        fclose(a.fp);
+        return ok ? 0 : 1;
+    }
+
+    event_source_t b;
+    cache_sim_t sim = {0};
+    if (trace != NULL) {
+        if (a.header.x != 0) {
+            printf("Error: %s was written with -x %s, but only bits "
+                   "indexing can be replayed\n",
+                   a.name, index_name(&a.header));
+            fclose(a.fp);
+            exit(1);
+        }
+        b.name = trace;
+        b.header = a.header;
+        b.fp = fopen(trace, "r");
+        if (b.fp == NULL) {
+            printf("Failed to open %s: %s\n", trace, strerror(errno));
+            exit(1);
+        }
+        if (!cacheSimInit(&sim, a.header.s, a.header.E, a.header.b)) {
+            exit(1);
+        }
+        b.sim = &sim;
+    } else if (!open_log(&b, argv[optind + 1])) {
+        exit(1);
+    }
+
+    bool same = diff_sources(&a, &b);
+    fclose(a.fp);
+    fclose(b.fp);
+    cacheSimFree(&sim);
+    return same ? 0 : 1;
+}
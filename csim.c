@@ -5,14 +5,20 @@
  *
  */
 
+#define _XOPEN_SOURCE 700 // fork, pipe, dup2
+
 #include "cachelab.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 /** @brief Lenth of maximum string length for reading from trace file */
@@ -21,6 +27,60 @@
 #define DECIMAL_BASE 10
 /** @brief Hex base number */
 #define HEX_BASE 16
+/** @brief Size of each half of the double-buffered trace reader */
+#define READ_CHUNK (1 << 20)
+/** @brief Number of leading bytes inspected for a compression magic */
+#define MAGIC_LEN 6
+/** @brief Size of the chunks the parallel parser decodes at once */
+#define PARSE_CHUNK (1 << 18)
+/** @brief Maximum number of parser threads */
+#define MAX_PARSE_THREADS 16
+/** @brief Shortest valid trace line, like "L0,1" plus its newline */
+#define MIN_LINE 5
+/** @brief Initial number of slots of the working-set table */
+#define WSET_INITIAL 1024
+/** @brief Signature distance at which a window starts a new phase */
+#define PHASE_THRESHOLD 0.1
+/** @brief Default entries and ways of the L1 TLB, like Haswell's DTLB */
+#define TLB_L1_ENTRIES 64
+#define TLB_L1_WAYS 4
+/** @brief Default entries and ways of the L2 TLB, like Haswell's STLB */
+#define TLB_L2_ENTRIES 1024
+#define TLB_L2_WAYS 8
+/** @brief Default cycles of an L1 TLB miss that hits in the L2 TLB */
+#define TLB_L2_CYCLES 7
+/** @brief Default cycles of a page walk, after a miss in both TLBs */
+#define TLB_WALK_CYCLES 30
+/** @brief Default number of MSHRs of the timing mode */
+#define TIMING_MSHRS 8
+/** @brief Most MSHRs the timing mode accepts */
+#define MAX_MSHRS 256
+/** @brief Number of records the event log buffers before writing them */
+#define EVENT_BUFFER 4096
+/** @brief First bytes of a checkpoint file */
+#define CHECKPOINT_MAGIC "CSIMCKP3"
+/** @brief Default number of accesses between two checkpoints */
+#define CHECKPOINT_EVERY 100000000UL
+
+/**
+ * @brief how an address is mapped to its set, selected with -x
+ *
+ * Plain bit extraction makes power-of-two strides map to few sets. The
+ * other functions spread them: XOR folding of all the block number bits,
+ * modulo a prime number of sets, and skewed associativity, where each way
+ * has its own hash function so that blocks conflicting in one way rarely
+ * conflict in the others. All but INDEX_BITS keep the whole block number as
+ * the tag.
+ */
+typedef enum {
+    INDEX_BITS,  /*the s bits above the block offset*/
+    INDEX_XOR,   /*the s-bit fields of the block number XORed together*/
+    INDEX_PRIME, /*block number modulo the largest prime up to 2^s*/
+    INDEX_SKEW   /*a different hash of the block number for each way*/
+} index_func_t;
+
+/** @brief names of the index functions for -x, in index_func_t order */
+const char *index_names[] = {"bits", "xor", "prime", "skew"};
 
 /**
  * @brief cache_line struct
@@ -49,6 +109,94 @@ csim_stats_t
 bool is_v_mode = false; /* Enable verbose mode, true if it is in verbose mode,
                            by defalue it is false*/
 
+bool is_parse_only = false; /* Only parse the trace without simulating it,
+                               used to benchmark the parser on its own*/
+
+long parse_threads = 1; /*number of parser threads, 0 for one per core*/
+
+unsigned long interval = 0;  /*accesses per window of -I, 0 if disabled*/
+FILE *interval_fp = NULL;    /*where the CSV of the windows goes*/
+
+char *checkpoint_file = NULL; /*checkpoint written periodically, or NULL*/
+unsigned long checkpoint_every = CHECKPOINT_EVERY; /*accesses between them*/
+unsigned long next_checkpoint = 0; /*access count of the next checkpoint*/
+unsigned long access_count = 0;    /*accesses simulated so far*/
+unsigned long trace_offset = 0;    /*bytes of the trace consumed so far*/
+
+unsigned long warmup = 0;  /*leading accesses of -W that are not counted*/
+bool is_roi_mode = false;  /*count only between ROI markers, for -R*/
+bool in_roi = false;       /*true between roi_begin and roi_end*/
+bool is_range = false;     /*count only accesses in [range_lo, range_hi)*/
+unsigned long range_lo = 0;
+unsigned long range_hi = 0;
+bool is_filtering = false; /*true if any of the above can exclude an access*/
+bool counting = true;      /*whether the current access is counted*/
+csim_stats_t excluded;     /*counts of the excluded accesses so far*/
+csim_stats_t paused_at;    /*stats when counting last stopped*/
+
+index_func_t index_func = INDEX_BITS; /*set index function of -x*/
+
+/**
+ * @brief one level of the TLB, set-associative with LRU replacement
+ */
+typedef struct {
+    unsigned long entries; /*number of entries, 0 if the level is absent*/
+    unsigned long ways;    /*entries per set*/
+    unsigned long *page;   /*page number plus one of each entry, 0 if empty*/
+    unsigned long *time;   /*LRU time of each entry*/
+    unsigned long hits;    /*lookups that found their page*/
+    unsigned long misses;  /*lookups that did not*/
+} tlb_level_t;
+
+bool is_tlb = false;   /*simulate the TLB of -T*/
+tlb_level_t tlb[2] = {{TLB_L1_ENTRIES, TLB_L1_WAYS, NULL, NULL, 0, 0},
+                      {TLB_L2_ENTRIES, TLB_L2_WAYS, NULL, NULL, 0, 0}};
+long page_bits = 12;   /*log2 of the page size*/
+unsigned long tlb_l2_cycles = TLB_L2_CYCLES;     /*cost of an L2 TLB hit*/
+unsigned long tlb_walk_cycles = TLB_WALK_CYCLES; /*cost of a page walk*/
+unsigned long tlb_timer = 0; /*LRU counter of the TLB*/
+
+/**
+ * @brief state of the timing mode, a non-blocking cache with MSHRs
+ *
+ * Accesses issue every issue cycles. A hit completes hit cycles later, a
+ * miss takes a free MSHR (miss status holding register) for latency cycles,
+ * and any access to a block whose fill is still pending merges into its
+ * MSHR. Such an access usually hits in the functional cache, which holds the
+ * block from its first miss on, so merges count accesses rather than misses.
+ * When all MSHRs are busy, a miss stalls the issue until one frees.
+ *
+ * Every access goes through the MSHRs, but only the counted ones (see -W,
+ * -R and -a) update the statistics and the histogram.
+ */
+typedef struct {
+    unsigned long mshrs;      /*number of MSHRs*/
+    unsigned long latency;    /*cycles of a miss*/
+    unsigned long hit;        /*cycles of a hit*/
+    unsigned long issue;      /*cycles between two accesses*/
+    unsigned long *block;     /*block number of each busy MSHR*/
+    unsigned long *fill;      /*cycle at which each busy MSHR fills*/
+    unsigned long busy;       /*number of busy MSHRs, first in the arrays*/
+    unsigned long now;        /*issue cycle of the next access*/
+    unsigned long clock;      /*cycle up to which histogram is counted*/
+    unsigned long finish;     /*cycle at which the last access completes*/
+    unsigned long cycles;     /*cycles the counted accesses pushed finish by*/
+    unsigned long stall;      /*cycles the issue waited for an MSHR*/
+    unsigned long primary;    /*misses that took an MSHR*/
+    unsigned long merged;     /*accesses, hits or misses, to a pending block*/
+    unsigned long *histogram; /*cycles with k busy MSHRs, k = 0..mshrs*/
+} timing_state_t;
+
+FILE *event_fp = NULL;      /*event log of -e, or NULL*/
+csim_event_t *event_buf;    /*records not written to the log yet*/
+size_t event_count = 0;     /*number of records in event_buf*/
+
+bool is_timing = false; /*simulate the timing mode of -m*/
+timing_state_t timing = {.mshrs = TIMING_MSHRS,
+                         .latency = MISS_CYCLES,
+                         .hit = HIT_CYCLES,
+                         .issue = 1};
+
 unsigned long LRU_timer = 0; /*global LRU_counter*/
 
 /**
@@ -73,6 +221,22 @@ void freeStats(void) {
     free(stats);
 }
 
+/**
+ * @brief largest prime number up to n, or 1 if n is 1
+ *
+ * @param n upper bound, at least 1
+ */
+long largestPrime(long n) {
+    for (; n > 2; n--) {
+        bool prime = true;
+        for (long d = 2; d * d <= n && prime; d++)
+            prime = (n % d != 0);
+        if (prime)
+            return n;
+    }
+    return n;
+}
+
 /**
  * @brief Initialize Cache 2d matrix
  *
@@ -81,6 +245,8 @@ void freeStats(void) {
  */
 void initCache(void) {
     set_number = 1 << set_bits;
+    if (index_func == INDEX_PRIME)
+        set_number = largestPrime(set_number);
     block_size = 1 << block_bits;
 
     cache = malloc((unsigned long)set_number * sizeof(cache_line *));
@@ -242,13 +408,13 @@ void handleMiss(long set_index, unsigned long tag, char operation,
  *
  * @param set_index set index information
  * @param operation operation char: S for store, L for read
- * @param hit_index hit index in the cache
+ * @param eviction_index index of the evicted line in the set
  *
  *
  *
  */
-void handleEviction(long set_index, unsigned long tag, char operation) {
-    long eviction_index = findEviction(tag, set_index);
+void handleEviction(long set_index, unsigned long tag, char operation,
+                    long eviction_index) {
 
     /*if the address that need to be evicted is dirty, update the statistics,*/
     if (cache[set_index][eviction_index].dirty) {
@@ -271,6 +437,169 @@ void handleEviction(long set_index, unsigned long tag, char operation) {
     stats->evictions++;
 }
 
+/**
+ * @brief write the buffered records to the event log
+ */
+void flushEvents(void) {
+    if (fwrite(event_buf, sizeof(csim_event_t), event_count, event_fp) !=
+        event_count) {
+        printf("Error writing event log: %s\n", strerror(errno));
+        exit(1);
+    }
+    event_count = 0;
+}
+
+/**
+ * @brief record an access in the event log, before the cache changes
+ *
+ * For an eviction, the line at set_index and way still holds the victim.
+ *
+ * @param operation operation char: S for store, L for read
+ * @param address   address of the access
+ * @param set_index set of the line accessed
+ * @param way       way of the line accessed
+ * @param outcome   hit, miss or eviction
+ */
+void logEvent(char operation, unsigned long address, long set_index, long way,
+              csim_outcome_t outcome) {
+    csim_event_t *e = &event_buf[event_count++];
+    memset(e, 0, sizeof(*e));
+    e->address = address;
+    e->set = (uint32_t)set_index;
+    e->way = (uint16_t)way;
+    e->op = operation;
+    e->outcome = (uint8_t)outcome;
+    if (outcome == CSIM_EVENT_EVICTION) {
+        e->victim_tag = cache[set_index][way].tag;
+        e->writeback = cache[set_index][way].dirty;
+    }
+    if (event_count == EVENT_BUFFER)
+        flushEvents();
+}
+
+/**
+ * @brief open the event log of -e and write its header
+ *
+ * @param name file name of the log
+ */
+void initEvents(const char *name) {
+    event_fp = fopen(name, "wb");
+    event_buf = malloc(EVENT_BUFFER * sizeof(csim_event_t));
+    if (event_fp == NULL || event_buf == NULL) {
+        printf("Error opening '%s': %s\n", name, strerror(errno));
+        exit(1);
+    }
+    csim_log_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CSIM_LOG_MAGIC, sizeof(header.magic));
+    header.s = (uint32_t)set_bits;
+    header.E = (uint32_t)associativity;
+    header.b = (uint32_t)block_bits;
+    header.x = (uint32_t)index_func;
+    if (fwrite(&header, sizeof(header), 1, event_fp) != 1) {
+        printf("Error writing event log: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+/**
+ * @brief write the last records and close the event log
+ */
+void closeEvents(void) {
+    flushEvents();
+    if (fclose(event_fp) != 0) {
+        printf("Error writing event log: %s\n", strerror(errno));
+        exit(1);
+    }
+    free(event_buf);
+}
+
+/**
+ * @brief set of a block number under INDEX_XOR or INDEX_PRIME
+ *
+ * @param block block number of the access
+ */
+long hashSet(unsigned long block) {
+    if (index_func == INDEX_PRIME)
+        return (long)(block % (unsigned long)set_number);
+
+    unsigned long mask = (1UL << set_bits) - 1;
+    unsigned long set = 0;
+    if (set_bits == 0)
+        return 0;
+    for (; block != 0; block >>= set_bits)
+        set ^= block & mask;
+    return (long)set;
+}
+
+/**
+ * @brief set of a block number in one way of the skewed cache
+ *
+ * Each way scrambles the block number with its own odd multiplier and keeps
+ * the top s bits, so the ways disagree on which blocks conflict.
+ *
+ * @param block block number of the access
+ * @param way   way of the cache
+ */
+long skewSet(unsigned long block, long way) {
+    if (set_bits == 0)
+        return 0;
+    unsigned long mult = 0x9e3779b97f4a7c15UL + 2UL * (unsigned long)way;
+    unsigned long h = (block ^ (block >> 29)) * mult;
+    return (long)(h >> (64 - set_bits));
+}
+
+/**
+ * @brief process an access in the skewed-associative cache
+ *
+ * Way j of the block lives in set skewSet(block, j). A miss fills an invalid
+ * candidate if there is one, and evicts the least recently used candidate
+ * otherwise.
+ *
+ * @param operation operation char: S for store, L for read
+ * @param address unsiged 64 bits address
+ */
+void processSkewed(char operation, unsigned long address) {
+    unsigned long tag = address >> block_bits;
+    long victim = -1;
+    long victim_set = 0;
+
+    for (long j = 0; j < associativity; j++) {
+        long set_index = skewSet(tag, j);
+        cache_line *line = &cache[set_index][j];
+        if (line->valid && line->tag == tag) {
+            if (event_fp != NULL)
+                logEvent(operation, address, set_index, j, CSIM_EVENT_HIT);
+            handleHit(set_index, operation, j);
+            if (is_v_mode)
+                printf("hits\n");
+            return;
+        }
+        /*invalid lines first, then the oldest one*/
+        if (victim == -1 ||
+            (cache[victim_set][victim].valid &&
+             (!line->valid || line->time < cache[victim_set][victim].time))) {
+            victim = j;
+            victim_set = set_index;
+        }
+    }
+
+    stats->misses++;
+    if (event_fp != NULL)
+        logEvent(operation, address, victim_set, victim,
+                 cache[victim_set][victim].valid ? CSIM_EVENT_EVICTION
+                                                 : CSIM_EVENT_MISS);
+    if (!cache[victim_set][victim].valid) {
+        handleMiss(victim_set, tag, operation, victim);
+        if (is_v_mode)
+            printf("miss\n");
+        return;
+    }
+    handleEviction(victim_set, tag, operation, victim);
+    if (is_v_mode)
+        printf("eviction\n");
+}
+
 /**
  * @brief process data and do the statistics based on different operation
  * Process data address and generate the set index and tag
@@ -281,16 +610,28 @@ void handleEviction(long set_index, unsigned long tag, char operation) {
  *
  */
 void processData(char operation, unsigned long address) {
+    if (index_func == INDEX_SKEW) {
+        processSkewed(operation, address);
+        return;
+    }
 
     /* extract tag and set index from address*/
     unsigned long tag = address >> (set_bits + block_bits);
 
-    long set_index = (address >> block_bits) & ((1 << set_bits) - 1);
+    long set_index = (long)((address >> block_bits) & ((1UL << set_bits) - 1));
+
+    if (index_func != INDEX_BITS) {
+        tag = address >> block_bits;
+        set_index = hashSet(tag);
+    }
 
     /*check if it is hit*/
     long hit_index = findHit(tag, set_index);
 
     if (hit_index != -1) {
+        if (event_fp != NULL)
+            logEvent(operation, address, set_index, hit_index,
+                     CSIM_EVENT_HIT);
         handleHit(set_index, operation, hit_index);
 
         if (is_v_mode)
@@ -305,6 +646,9 @@ void processData(char operation, unsigned long address) {
     long miss_index = findMiss(tag, set_index);
 
     if (miss_index != -1) {
+        if (event_fp != NULL)
+            logEvent(operation, address, set_index, miss_index,
+                     CSIM_EVENT_MISS);
         handleMiss(set_index, tag, operation, miss_index);
 
         if (is_v_mode)
@@ -315,165 +659,1683 @@ void processData(char operation, unsigned long address) {
 
     /*if the code run this section, it means a eviction so update the eviction
      * information*/
-    handleEviction(set_index, tag, operation);
+    long eviction_index = findEviction(tag, set_index);
+    if (event_fp != NULL)
+        logEvent(operation, address, set_index, eviction_index,
+                 CSIM_EVENT_EVICTION);
+    handleEviction(set_index, tag, operation, eviction_index);
 
     if (is_v_mode)
         printf("eviction\n");
 }
 
-/** @brief Process a memory-access trace file.
+/**
+ * @brief look a page up in one level of the TLB, filling it on a miss
  *
- * @param trace Name of the trace file to process
- * @return 0 if successful, 1 if there were error
+ * @param level TLB level to search
+ * @param page  page number of the access
+ * @return      true on a hit
  */
-int process_trace_file(const char *trace) {
+bool tlbLookup(tlb_level_t *level, unsigned long page) {
+    unsigned long sets = level->entries / level->ways;
+    unsigned long *entry = &level->page[(page % sets) * level->ways];
+    unsigned long *time = &level->time[(page % sets) * level->ways];
+    unsigned long victim = 0;
+
+    tlb_timer++;
+    for (unsigned long i = 0; i < level->ways; i++) {
+        if (entry[i] == page + 1) {
+            time[i] = tlb_timer;
+            return true;
+        }
+        if (time[i] < time[victim])
+            victim = i;
+    }
+    entry[victim] = page + 1;
+    time[victim] = tlb_timer;
+    return false;
+}
 
-    FILE *tfp = fopen(trace, "rt");
-    if (!tfp) {
-        fprintf(stderr, "Error opening '%s': %s\n", trace, strerror(errno));
-        exit(1);
+/**
+ * @brief translate the address of an access through the TLB
+ *
+ * A miss in the L1 TLB looks in the L2 TLB, and a miss there walks the page
+ * table; both levels are filled with the page. Only counted accesses (see
+ * -W, -R and -a) update the statistics.
+ *
+ * @param address address of the access
+ */
+void tlbAccess(unsigned long address) {
+    unsigned long page = address >> page_bits;
+    bool hit = tlbLookup(&tlb[0], page);
+    if (counting) {
+        tlb[0].hits += hit;
+        tlb[0].misses += !hit;
     }
-    char linebuf[LINELEN];
-    int parse_error = 0;
-    while (fgets(linebuf, LINELEN, tfp)) {
-        /*Check Invalid operation otherthan store or read*/
-        if (linebuf[0] != 'S' && linebuf[0] != 'L') {
-            printf("%c\n", linebuf[0]);
-            printf("Invalid operation or address in trace file\n");
+    if (hit || tlb[1].entries == 0)
+        return;
+    hit = tlbLookup(&tlb[1], page);
+    if (counting) {
+        tlb[1].hits += hit;
+        tlb[1].misses += !hit;
+    }
+}
 
+/**
+ * @brief allocate the empty TLB levels
+ */
+void initTlb(void) {
+    for (int i = 0; i < 2; i++) {
+        if (tlb[i].entries == 0)
+            continue;
+        tlb[i].page = calloc(tlb[i].entries, sizeof(unsigned long));
+        tlb[i].time = calloc(tlb[i].entries, sizeof(unsigned long));
+        if (tlb[i].page == NULL || tlb[i].time == NULL) {
+            printf("Failed to allocate memory\n");
             exit(1);
         }
+    }
+}
 
-        /*read operation, address, and size*/
-        char operation = linebuf[0];
-
-        unsigned long address;
-
-        unsigned long size;
-
-        int ret = sscanf(linebuf + 1, " %lx,%lu", &address, &size);
+/**
+ * @brief print the TLB statistics and the cycles they add, then free the TLB
+ *
+ * The estimate charges the cache hits and misses like test-trans, an L1 TLB
+ * miss that hits in the L2 TLB tlb_l2_cycles, and a page walk
+ * tlb_walk_cycles.
+ *
+ * @param counted statistics of the counted accesses
+ */
+void printTlb(const csim_stats_t *counted) {
+    unsigned long walks = tlb[1].entries > 0 ? tlb[1].misses : tlb[0].misses;
+    unsigned long cycles = HIT_CYCLES * counted->hits +
+                           MISS_CYCLES * counted->misses +
+                           tlb_l2_cycles * tlb[1].hits +
+                           tlb_walk_cycles * walks;
+    printf("tlb_l1_hits:%lu tlb_l1_misses:%lu tlb_l2_hits:%lu "
+           "tlb_l2_misses:%lu page_walks:%lu cycles:%lu\n",
+           tlb[0].hits, tlb[0].misses, tlb[1].hits, tlb[1].misses, walks,
+           cycles);
+    for (int i = 0; i < 2; i++) {
+        free(tlb[i].page);
+        free(tlb[i].time);
+    }
+}
 
-        /*If the number of return value is not 2, meaning there is an error for
-         * reading files*/
-        if (ret != 2) {
-            printf("Error reading trace file\n");
+/**
+ * @brief set up the TLB from the argument of -T
+ *
+ * The argument is a comma-separated list of page=<size> (4k, 2m, 1g or a
+ * power of two in bytes), l1=<entries>x<ways>, l2=<entries>x<ways> (l2=0
+ * for no L2 TLB), l2cycles=<n> and walk=<n>, any of which may be omitted.
+ *
+ * @param spec argument of -T, modified in place
+ */
+void parseTlbSpec(char *spec) {
+    is_tlb = true;
+    for (char *item = strtok(spec, ","); item != NULL;
+         item = strtok(NULL, ",")) {
+        unsigned long value;
+        char unit = 0;
+        bool ok = true;
+        if (strncmp(item, "page=", 5) == 0) {
+            ok = sscanf(item + 5, "%lu%c", &value, &unit) >= 1;
+            if (unit == 'k' || unit == 'K')
+                value <<= 10;
+            else if (unit == 'm' || unit == 'M')
+                value <<= 20;
+            else if (unit == 'g' || unit == 'G')
+                value <<= 30;
+            else
+                ok = ok && unit == 0;
+            for (page_bits = 0; ok && (1UL << page_bits) < value; page_bits++)
+                ;
+            ok = ok && value > 0 && (1UL << page_bits) == value;
+        } else if (strncmp(item, "l1=", 3) == 0 ||
+                   strncmp(item, "l2=", 3) == 0) {
+            tlb_level_t *level = &tlb[item[1] - '1'];
+            if (strcmp(item + 3, "0") == 0 && item[1] == '2') {
+                level->entries = 0;
+                continue;
+            }
+            ok = sscanf(item + 3, "%lux%lu", &level->entries,
+                        &level->ways) == 2 &&
+                 level->ways > 0 && level->entries >= level->ways &&
+                 level->entries % level->ways == 0;
+        } else if (strncmp(item, "l2cycles=", 9) == 0) {
+            ok = sscanf(item + 9, "%lu", &tlb_l2_cycles) == 1;
+        } else if (strncmp(item, "walk=", 5) == 0) {
+            ok = sscanf(item + 5, "%lu", &tlb_walk_cycles) == 1;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            printf("Error: invalid TLB setting '%s'\n", item);
             exit(1);
         }
-        /*The size should not greater than 64*/
-        if (size > 64) {
-            printf("Invalid size\n");
+    }
+}
+
+/**
+ * @brief set up the timing mode from the argument of -m
+ *
+ * The argument is a comma-separated list of mshrs=<n>, latency=<cycles>,
+ * hit=<cycles> and issue=<cycles>, any of which may be omitted.
+ *
+ * @param spec argument of -m, modified in place
+ */
+void parseTimingSpec(char *spec) {
+    is_timing = true;
+    for (char *item = strtok(spec, ","); item != NULL;
+         item = strtok(NULL, ",")) {
+        char key[16];
+        unsigned long value;
+        bool ok = sscanf(item, "%15[a-z]=%lu", key, &value) == 2;
+        if (ok && strcmp(key, "mshrs") == 0)
+            timing.mshrs = value;
+        else if (ok && strcmp(key, "latency") == 0)
+            timing.latency = value;
+        else if (ok && strcmp(key, "hit") == 0)
+            timing.hit = value;
+        else if (ok && strcmp(key, "issue") == 0)
+            timing.issue = value;
+        else
+            ok = false;
+        if (!ok || timing.mshrs < 1 || timing.mshrs > MAX_MSHRS) {
+            printf("Error: invalid timing setting '%s'\n", item);
             exit(1);
         }
-        /*enable verobase mode for debug using, show the each operatio hit, miss
-         * or eviction*/
-        if (is_v_mode)
-            printf("%c %lu, %lu ", operation, address, size);
+    }
+}
 
-        processData(operation, address);
+/**
+ * @brief allocate the MSHRs of the timing mode
+ */
+void initTiming(void) {
+    timing.block = calloc(timing.mshrs, sizeof(unsigned long));
+    timing.fill = calloc(timing.mshrs, sizeof(unsigned long));
+    timing.histogram = calloc(timing.mshrs + 1, sizeof(unsigned long));
+    if (timing.block == NULL || timing.fill == NULL ||
+        timing.histogram == NULL) {
+        printf("Failed to allocate memory\n");
+        exit(1);
     }
-    fclose(tfp);
-    return parse_error;
 }
 
 /**
- * @brief print help message
+ * @brief index of the busy MSHR that fills first
  */
-void printHelp(void) {
-    printf("Usage: ./csim [-v] -s <s> -b <b> -E <E> -t <trace>\n");
-    printf("       ./csim -h\n");
-    printf("    -h          Print this help message and exit\n");
-    printf("    -v          Verbose mode: report effects of each memory "
-           "operation\n");
-    printf("    -s <s>      Number of set index bits (there are 2**s sets)\n");
-    printf("    -b <b>      Number of block bits (there are 2**b blocks)\n");
-    printf("    -E <E>      Number of lines per set (associativity)\n");
-    printf("    -t <trace>  File name of the memory trace to process\n\n");
-    printf("The -s, -b, -E, and -t options must be supplied for all "
-           "simulations.\n");
+unsigned long firstFill(void) {
+    unsigned long first = 0;
+    for (unsigned long i = 1; i < timing.busy; i++) {
+        if (timing.fill[i] < timing.fill[first])
+            first = i;
+    }
+    return first;
 }
 
 /**
- * @brief main function
+ * @brief free the MSHRs that fill up to cycle t, counting their occupancy
  *
- * @param [in] argv Command Line argument,  [-v] -s <s> -E <E> -b <b> -t <trace>
+ * @param t cycle to advance the clock to
  */
-int main(int argc, char *argv[]) {
-    int opt;
-    /*read commamd line argument, -s for set bits, -E for asssociativity,
-     -b for block bits, -t for file name*/
-    while ((opt = getopt(argc, argv, "vhs:E:b:t:")) != -1) {
-        switch (opt) {
-        case 'v':
-            printf("This is v mode\n");
-            is_v_mode = true;
-
-            break;
-
-        case 'h':
-            printHelp();
+void advanceTo(unsigned long t) {
+    while (timing.busy > 0) {
+        unsigned long i = firstFill();
+        if (timing.fill[i] > t)
             break;
+        if (counting)
+            timing.histogram[timing.busy] += timing.fill[i] - timing.clock;
+        timing.clock = timing.fill[i];
+        timing.busy--;
+        timing.block[i] = timing.block[timing.busy];
+        timing.fill[i] = timing.fill[timing.busy];
+    }
+    if (counting)
+        timing.histogram[timing.busy] += t - timing.clock;
+    timing.clock = t;
+}
 
-        case 's':
-            set_bits = strtol(optarg, NULL, DECIMAL_BASE);
-            break;
+/**
+ * @brief time one access in the timing mode
+ *
+ * A counted access adds to the cycles as much as it delays the completion
+ * of all the accesses so far, so without -W, -R or -a the cycles are those
+ * of the whole trace.
+ *
+ * @param address address of the access
+ * @param miss    true if the functional cache missed
+ */
+void timingAccess(unsigned long address, bool miss) {
+    unsigned long block = address >> block_bits;
+    unsigned long done = timing.now + timing.hit;
+    advanceTo(timing.now);
+
+    bool merged = false;
+    for (unsigned long i = 0; i < timing.busy && !merged; i++) {
+        if (timing.block[i] == block) {
+            if (counting)
+                timing.merged++;
+            done = timing.fill[i];
+            merged = true;
+        }
+    }
 
-        case 'E':
-            associativity = strtol(optarg, NULL, DECIMAL_BASE);
-            break;
+    if (!merged && miss) {
+        if (timing.busy == timing.mshrs) {
+            unsigned long free_at = timing.fill[firstFill()];
+            if (counting)
+                timing.stall += free_at - timing.now;
+            timing.now = free_at;
+            advanceTo(timing.now);
+        }
+        timing.block[timing.busy] = block;
+        timing.fill[timing.busy] = timing.now + timing.latency;
+        done = timing.fill[timing.busy];
+        timing.busy++;
+        if (counting)
+            timing.primary++;
+    }
 
-        case 'b':
-            block_bits = strtol(optarg, NULL, DECIMAL_BASE);
+    if (done > timing.finish) {
+        if (counting)
+            timing.cycles += done - timing.finish;
+        timing.finish = done;
+    }
+    timing.now += timing.issue;
+}
 
-            break;
+/**
+ * @brief print the results of the timing mode, then free its MSHRs
+ *
+ * The occupancy histogram gives, for every number of busy MSHRs, the cycles
+ * spent with that many misses in flight.
+ */
+void printTiming(void) {
+    advanceTo(timing.finish);
+    printf("cycles:%lu stall_cycles:%lu primary_misses:%lu "
+           "merged_accesses:%lu\n",
+           timing.cycles, timing.stall, timing.primary, timing.merged);
+    printf("mshr_occupancy:");
+    for (unsigned long k = 0; k <= timing.mshrs; k++)
+        printf(" %lu:%lu", k, timing.histogram[k]);
+    printf("\n");
+    free(timing.block);
+    free(timing.fill);
+    free(timing.histogram);
+}
 
-        case 't':
-            file_name = optarg;
-            break;
+/**
+ * @brief Statistics of the current window of the interval mode
+ *
+ * The working set is the number of distinct blocks the window touched,
+ * counted with an open-addressing table of block numbers plus one, so that
+ * zero marks an empty slot.
+ */
+typedef struct {
+    csim_stats_t start;       /*totals when the window started*/
+    unsigned long first;      /*index of the first access of the window*/
+    unsigned long accesses;   /*accesses in the window so far*/
+    unsigned long length;     /*accesses after which the window ends*/
+    unsigned long number;     /*index of the window*/
+    unsigned long *wset;      /*table of the blocks touched*/
+    unsigned long wset_cap;   /*number of slots, a power of two*/
+    unsigned long wset_size;  /*number of distinct blocks touched*/
+    double phase_miss_rate;   /*mean miss rate of the current phase*/
+    double phase_wset_ratio;  /*mean working set per access of the phase*/
+    unsigned long phase_len;  /*number of windows in the current phase*/
+    unsigned long phase;      /*index of the current phase*/
+} interval_state_t;
+
+interval_state_t window; /*state of the interval mode*/
 
-        case ':':
-            printf("Mandatory arguments missing or zero.\n");
-            printHelp();
-            exit(1);
-            break;
+/**
+ * @brief start the interval mode, writing the CSV header
+ */
+void initInterval(void) {
+    memset(&window, 0, sizeof(window));
+    window.length = interval;
+    window.wset_cap = WSET_INITIAL;
+    window.wset = calloc(window.wset_cap, sizeof(unsigned long));
+    if (window.wset == NULL) {
+        printf("Failed to allocate memory\n");
+        exit(1);
+    }
+    fprintf(interval_fp, "window,first_access,accesses,hits,misses,"
+                         "evictions,dirty_bytes,dirty_evictions,"
+                         "working_set,miss_rate,phase,phase_change\n");
+}
 
-        case '?':
-            printf("Error while parsing arguments.");
-            printHelp();
+/**
+ * @brief add a block to the working set of the window
+ *
+ * @param block block number of the access
+ */
+void addToWorkingSet(unsigned long block) {
+    unsigned long key = block + 1;
+    unsigned long mask = window.wset_cap - 1;
+    unsigned long i = ((key * 0x9e3779b97f4a7c15UL) >> 20) & mask;
+    while (window.wset[i] != 0) {
+        if (window.wset[i] == key)
+            return;
+        i = (i + 1) & mask;
+    }
+    window.wset[i] = key;
+    window.wset_size++;
+
+    /*keep the table at most half full*/
+    if (2 * window.wset_size > window.wset_cap) {
+        unsigned long *old = window.wset;
+        unsigned long old_cap = window.wset_cap;
+        window.wset_cap *= 2;
+        window.wset = calloc(window.wset_cap, sizeof(unsigned long));
+        if (window.wset == NULL) {
+            printf("Failed to allocate memory\n");
             exit(1);
-
-            break;
         }
+        window.wset_size = 0;
+        for (unsigned long j = 0; j < old_cap; j++) {
+            if (old[j] != 0)
+                addToWorkingSet(old[j] - 1);
+        }
+        free(old);
     }
+}
 
-    /*associativity and file name cannot be zero or null, exit the program if it
-     * does not meet the requirment*/
-    if (associativity == 0 || file_name == NULL) {
-        printf("Mandatory arguments missing or zero.\n");
-        printHelp();
-        exit(1);
-    }
-
-    /*All set_bits, block bits, should not be negative,
-    and the number of set_block and block bits cannot be greater than address,
-    and there must be a tag bits */
-    if (set_bits < 0 || block_bits < 0 || set_bits + block_bits > 63) {
-        printf("Error: s + b is too large (s = %lu, b = %lu)\n", set_bits,
-               block_bits);
-        exit(1);
+/**
+ * @brief write the statistics of the window and start the next one
+ *
+ * The phase detector compares the signature of the window, its miss rate
+ * and its working set per access, with the mean signature of the windows of
+ * the current phase. A window further than PHASE_THRESHOLD away starts a
+ * new phase.
+ */
+void endWindow(void) {
+    unsigned long hits = stats->hits - window.start.hits;
+    unsigned long misses = stats->misses - window.start.misses;
+    double miss_rate = (double)misses / (double)window.accesses;
+    double wset_ratio = (double)window.wset_size / (double)window.accesses;
+
+    bool change = false;
+    if (window.phase_len > 0) {
+        double d_miss = miss_rate - window.phase_miss_rate;
+        double d_wset = wset_ratio - window.phase_wset_ratio;
+        double distance = (d_miss < 0 ? -d_miss : d_miss) +
+                          (d_wset < 0 ? -d_wset : d_wset);
+        change = distance > PHASE_THRESHOLD;
     }
-    /*associativity can not be less 1*/
-    if (associativity < 1) {
-
-        printf("Failed to allocate memory\n");
-        exit(1);
+    if (change) {
+        window.phase++;
+        window.phase_len = 0;
     }
-    /*Do the simulation*/
+    window.phase_len++;
+    window.phase_miss_rate +=
+        (miss_rate - window.phase_miss_rate) / (double)window.phase_len;
+    window.phase_wset_ratio +=
+        (wset_ratio - window.phase_wset_ratio) / (double)window.phase_len;
+
+    fprintf(interval_fp, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.6f,%lu,%d\n",
+            window.number, window.first, window.accesses, hits, misses,
+            stats->evictions - window.start.evictions, stats->dirty_bytes,
+            stats->dirty_evictions - window.start.dirty_evictions,
+            window.wset_size, miss_rate, window.phase, change);
+
+    window.number++;
+    window.first += window.accesses;
+    window.accesses = 0;
+    window.length = interval;
+    window.start = *stats;
+    window.wset_size = 0;
+    memset(window.wset, 0, window.wset_cap * sizeof(unsigned long));
+}
 
-    initCache();
+/**
+ * @brief account for one simulated access in the interval mode
+ *
+ * @param address address of the access
+ */
+void intervalAccess(unsigned long address) {
+    addToWorkingSet(address >> block_bits);
+    window.accesses++;
+    if (window.accesses == window.length)
+        endWindow();
+}
+
+/**
+ * @brief write the last, partial window and stop the interval mode
+ */
+void freeInterval(void) {
+    if (window.accesses > 0)
+        endWindow();
+    free(window.wset);
+    fflush(interval_fp);
+}
+
+/**
+ * @brief add the counts of b minus those of a to sum
+ *
+ * dirty_bytes is left alone: it describes the cache contents, which the
+ * excluded accesses change like any other.
+ */
+void addCounts(csim_stats_t *sum, const csim_stats_t *b,
+               const csim_stats_t *a) {
+    sum->hits += b->hits - a->hits;
+    sum->misses += b->misses - a->misses;
+    sum->evictions += b->evictions - a->evictions;
+    sum->dirty_evictions += b->dirty_evictions - a->dirty_evictions;
+}
+
+/**
+ * @brief start or stop counting the accesses
+ *
+ * Excluded accesses still go through the cache, so that they warm it up,
+ * and stats keeps growing for the interval mode; only their counts are
+ * set aside in excluded.
+ *
+ * @param on true to count the next accesses
+ */
+void setCounting(bool on) {
+    if (on == counting)
+        return;
+    if (on)
+        addCounts(&excluded, stats, &paused_at);
+    else
+        paused_at = *stats;
+    counting = on;
+}
+
+/**
+ * @brief whether an access counts, given -W, -R and -a
+ *
+ * @param address address of the access
+ */
+bool isCounted(unsigned long address) {
+    if (access_count < warmup)
+        return false;
+    if (is_roi_mode && !in_roi)
+        return false;
+    if (is_range && (address < range_lo || address >= range_hi))
+        return false;
+    return true;
+}
+
+/**
+ * @brief the statistics of the counted accesses only
+ *
+ * @param out where to store them
+ */
+void countedStats(csim_stats_t *out) {
+    *out = *stats;
+    if (!counting) {
+        out->hits = paused_at.hits;
+        out->misses = paused_at.misses;
+        out->evictions = paused_at.evictions;
+        out->dirty_evictions = paused_at.dirty_evictions;
+    }
+    out->hits -= excluded.hits;
+    out->misses -= excluded.misses;
+    out->evictions -= excluded.evictions;
+    out->dirty_evictions -= excluded.dirty_evictions;
+}
+
+/**
+ * @brief Double-buffered trace input
+ *
+ * A reader thread fills one buffer from the input descriptor while the
+ * simulation parses the other one, so reading (and decompression, which runs
+ * in a child process feeding that descriptor) overlaps the simulation.
+ */
+typedef struct {
+    int fd;          /*descriptor the reader thread drains*/
+    pid_t decoder;   /*decompressor child, -1 if the input is plain text*/
+    pid_t feeder;    /*child copying a pipe into the decoder, -1 if unused*/
+    char *buf[2];    /*the two halves of the double buffer*/
+    size_t len[2];   /*number of valid bytes in each half*/
+    bool full[2];    /*true while a half is owned by the parser*/
+    int read_errno;  /*errno of a failed read, 0 if none*/
+    int cur;         /*half currently being parsed*/
+    bool owned;      /*true once the parser has taken the current half*/
+    bool eof;        /*true once the end-of-input half has been seen*/
+    size_t avail;    /*number of bytes in the current half*/
+    size_t pos;      /*parse position inside the current half*/
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} trace_reader_t;
+
+/**
+ * @brief read from a descriptor until the buffer is full or input ends
+ *
+ * @param fd   descriptor to read from
+ * @param buf  destination buffer
+ * @param len  number of bytes already in the buffer
+ * @param cap  capacity of the buffer
+ * @return     total bytes in the buffer, or -1 with errno set on error
+ */
+ssize_t readFully(int fd, char *buf, size_t len, size_t cap) {
+    while (len < cap) {
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        len += (size_t)n;
+    }
+    return (ssize_t)len;
+}
+
+/**
+ * @brief reader thread: fill the two halves alternately until end of input
+ *
+ * A half published with zero length marks the end of the input.
+ */
+void *readerThread(void *arg) {
+    trace_reader_t *r = arg;
+    int i = r->cur;
+    size_t start = r->len[i]; /*the first half may already hold the magic*/
+
+    while (true) {
+        pthread_mutex_lock(&r->lock);
+        while (r->full[i])
+            pthread_cond_wait(&r->cond, &r->lock);
+        pthread_mutex_unlock(&r->lock);
+
+        ssize_t n = readFully(r->fd, r->buf[i], start, READ_CHUNK);
+        start = 0;
+
+        pthread_mutex_lock(&r->lock);
+        if (n < 0) {
+            r->read_errno = errno;
+            n = 0;
+        }
+        r->len[i] = (size_t)n;
+        r->full[i] = true;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+
+        if (n == 0)
+            return NULL;
+        i ^= 1;
+    }
+}
+
+/**
+ * @brief get the decompressor command for the leading bytes of a trace
+ *
+ * @param magic leading bytes of the input
+ * @param len   number of valid bytes in magic
+ * @return      decompressor program name, or NULL for a plain-text trace
+ */
+const char *findDecoder(const unsigned char *magic, size_t len) {
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return "gzip";
+    if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+        magic[3] == 0xfd)
+        return "zstd";
+    if (len >= 6 && magic[0] == 0xfd && magic[1] == '7' && magic[2] == 'z' &&
+        magic[3] == 'X' && magic[4] == 'Z' && magic[5] == 0x00)
+        return "xz";
+    return NULL;
+}
+
+/**
+ * @brief start a decompressor whose output replaces the reader's input
+ *
+ * Seekable inputs are rewound and handed to the decompressor directly.
+ * Pipes cannot be rewound, so a feeder child writes the already consumed
+ * magic bytes followed by the rest of the input into the decompressor.
+ *
+ * @param r       reader whose descriptor is replaced
+ * @param decoder decompressor program name
+ * @param magic   bytes already consumed from the input
+ * @param len     number of bytes already consumed
+ */
+void startDecoder(trace_reader_t *r, const char *decoder, const char *magic,
+                  size_t len) {
+    int in_fd = r->fd;
+    int out_pipe[2];
+    int feed_pipe[2] = {-1, -1};
+
+    if (pipe(out_pipe) < 0) {
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+    fflush(stdout);
+
+    if (lseek(in_fd, 0, SEEK_SET) < 0) {
+        if (pipe(feed_pipe) < 0) {
+            fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+            exit(1);
+        }
+        r->feeder = fork();
+        if (r->feeder < 0) {
+            fprintf(stderr, "Error forking feeder: %s\n", strerror(errno));
+            exit(1);
+        }
+        if (r->feeder == 0) {
+            char copybuf[BUFSIZ];
+            close(feed_pipe[0]);
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            ssize_t n = (ssize_t)len;
+            memcpy(copybuf, magic, len);
+            do {
+                if (write(feed_pipe[1], copybuf, (size_t)n) != n)
+                    _exit(1);
+                n = read(in_fd, copybuf, sizeof(copybuf));
+            } while (n > 0);
+            _exit(n < 0);
+        }
+        close(feed_pipe[1]);
+        in_fd = feed_pipe[0];
+    }
+
+    r->decoder = fork();
+    if (r->decoder < 0) {
+        fprintf(stderr, "Error forking %s: %s\n", decoder, strerror(errno));
+        exit(1);
+    }
+    if (r->decoder == 0) {
+        dup2(in_fd, STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        execlp(decoder, decoder, "-dc", (char *)NULL);
+        fprintf(stderr, "Error running %s: %s\n", decoder, strerror(errno));
+        _exit(127);
+    }
+
+    close(out_pipe[1]);
+    if (in_fd != r->fd)
+        close(in_fd);
+    if (r->fd != STDIN_FILENO)
+        close(r->fd);
+    r->fd = out_pipe[0];
+}
+
+/**
+ * @brief open a trace for double-buffered reading
+ *
+ * @param r     reader to initialize
+ * @param trace trace file name, or "-" for standard input
+ */
+void readerOpen(trace_reader_t *r, const char *trace) {
+    memset(r, 0, sizeof(*r));
+    r->decoder = -1;
+    r->feeder = -1;
+
+    if (strcmp(trace, "-") == 0) {
+        r->fd = STDIN_FILENO;
+    } else {
+        r->fd = open(trace, O_RDONLY);
+        if (r->fd < 0) {
+            fprintf(stderr, "Error opening '%s': %s\n", trace,
+                    strerror(errno));
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        r->buf[i] = malloc(READ_CHUNK);
+        if (r->buf[i] == NULL) {
+            printf("Failed to allocate memory\n");
+            exit(1);
+        }
+    }
+
+    /*sniff the compression magic; plain text keeps it as its first bytes*/
+    ssize_t n = readFully(r->fd, r->buf[0], 0, MAGIC_LEN);
+    if (n < 0) {
+        fprintf(stderr, "Error reading '%s': %s\n", trace, strerror(errno));
+        exit(1);
+    }
+    const char *decoder =
+        findDecoder((const unsigned char *)r->buf[0], (size_t)n);
+    if (decoder != NULL) {
+        startDecoder(r, decoder, r->buf[0], (size_t)n);
+        n = 0;
+    }
+    r->len[0] = (size_t)n;
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, readerThread, r) != 0) {
+        fprintf(stderr, "Error starting trace reader thread\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief move the parser on to the next half filled by the reader thread
+ *
+ * @param r reader to advance
+ * @return  false at the end of the input
+ */
+bool readerNextChunk(trace_reader_t *r) {
+    if (r->eof)
+        return false;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->owned) {
+        /*hand the consumed half back to the reader thread*/
+        r->full[r->cur] = false;
+        pthread_cond_broadcast(&r->cond);
+        r->cur ^= 1;
+    }
+    while (!r->full[r->cur])
+        pthread_cond_wait(&r->cond, &r->lock);
+    r->owned = true;
+    r->avail = r->len[r->cur];
+    r->pos = 0;
+    pthread_mutex_unlock(&r->lock);
+
+    r->eof = (r->avail == 0);
+    return !r->eof;
+}
+
+/**
+ * @brief read one line from the trace, with the semantics of fgets
+ *
+ * @param r   reader to read from
+ * @param out destination buffer
+ * @param len size of the destination buffer
+ * @return    out, or NULL at the end of the input
+ */
+char *readerGetLine(trace_reader_t *r, char *out, size_t len) {
+    size_t n = 0;
+    while (n + 1 < len) {
+        if (r->pos == r->avail && !readerNextChunk(r))
+            break;
+        char c = r->buf[r->cur][r->pos++];
+        out[n++] = c;
+        if (c == '\n')
+            break;
+    }
+    if (n == 0)
+        return NULL;
+    out[n] = '\0';
+    return out;
+}
+
+/**
+ * @brief release a trace reader and check that decompression succeeded
+ *
+ * @param r     reader to close
+ * @param trace trace file name for error messages
+ */
+void readerClose(trace_reader_t *r, const char *trace) {
+    pthread_join(r->thread, NULL);
+    if (r->read_errno != 0) {
+        fprintf(stderr, "Error reading '%s': %s\n", trace,
+                strerror(r->read_errno));
+        exit(1);
+    }
+    if (r->fd != STDIN_FILENO)
+        close(r->fd);
+
+    pid_t children[2] = {r->feeder, r->decoder};
+    for (int i = 0; i < 2; i++) {
+        int status;
+        if (children[i] < 0)
+            continue;
+        if (waitpid(children[i], &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error decompressing '%s'\n", trace);
+            exit(1);
+        }
+    }
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r->buf[0]);
+    free(r->buf[1]);
+}
+
+/**
+ * @brief copy up to len bytes of the trace, spanning the two halves
+ *
+ * @param r   reader to read from
+ * @param out destination buffer
+ * @param len size of the destination buffer
+ * @return    number of bytes copied, 0 at the end of the input
+ */
+size_t readerRead(trace_reader_t *r, char *out, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        if (r->pos == r->avail && !readerNextChunk(r))
+            break;
+        size_t take = r->avail - r->pos;
+        if (take > len - n)
+            take = len - n;
+        memcpy(out + n, r->buf[r->cur] + r->pos, take);
+        r->pos += take;
+        n += take;
+    }
+    return n;
+}
+
+/**
+ * @brief fixed-size start of a checkpoint file
+ *
+ * It is followed by every cache line, set by set, each packed as its tag,
+ * its LRU time and a byte with the valid (1) and dirty (2) bits.
+ */
+typedef struct {
+    char magic[8];               /*CHECKPOINT_MAGIC*/
+    long set_bits;               /*geometry the state belongs to*/
+    long associativity;
+    long block_bits;
+    long index_func;             /*index_func_t of the cache*/
+    unsigned long LRU_timer;     /*global LRU counter*/
+    unsigned long trace_offset;  /*bytes of the trace consumed*/
+    unsigned long access_count;  /*accesses simulated*/
+    long in_roi;                 /*1 inside the region of interest*/
+    csim_stats_t stats;          /*statistics of the counted accesses*/
+} checkpoint_header_t;
+
+/**
+ * @brief write the whole simulator state to checkpoint_file
+ *
+ * The state goes to a temporary file first, which then replaces the
+ * checkpoint, so a crash while writing leaves the previous one intact.
+ */
+void writeCheckpoint(void) {
+    char tmp_name[PATH_MAX];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", checkpoint_file);
+    FILE *fp = fopen(tmp_name, "wb");
+    if (fp == NULL) {
+        printf("Error opening '%s': %s\n", tmp_name, strerror(errno));
+        exit(1);
+    }
+
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.set_bits = set_bits;
+    header.associativity = associativity;
+    header.block_bits = block_bits;
+    header.index_func = index_func;
+    header.LRU_timer = LRU_timer;
+    header.trace_offset = trace_offset;
+    header.access_count = access_count;
+    header.in_roi = in_roi;
+    countedStats(&header.stats);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    for (long i = 0; ok && i < set_number; i++) {
+        for (long j = 0; ok && j < associativity; j++) {
+            cache_line *line = &cache[i][j];
+            unsigned char flags =
+                (unsigned char)((line->valid ? 1 : 0) | (line->dirty ? 2 : 0));
+            ok = fwrite(&line->tag, sizeof(line->tag), 1, fp) == 1 &&
+                 fwrite(&line->time, sizeof(line->time), 1, fp) == 1 &&
+                 fwrite(&flags, 1, 1, fp) == 1;
+        }
+    }
+
+    if (fclose(fp) != 0 || !ok || rename(tmp_name, checkpoint_file) != 0) {
+        printf("Error writing checkpoint '%s': %s\n", checkpoint_file,
+               strerror(errno));
+        exit(1);
+    }
+}
+
+/**
+ * @brief write a checkpoint if enough accesses were simulated since the last
+ *
+ * Called between lines, or between chunks of the parallel parser, so that
+ * the saved offset always falls at the start of a line.
+ */
+void maybeCheckpoint(void) {
+    if (checkpoint_file != NULL && access_count >= next_checkpoint) {
+        writeCheckpoint();
+        next_checkpoint = access_count + checkpoint_every;
+    }
+}
+
+/**
+ * @brief load the simulator state from a checkpoint
+ *
+ * A full restore resumes the simulation where the checkpoint was taken. A
+ * warm start only loads the cache contents, to simulate another trace from
+ * its beginning on a warm cache; the statistics then start from zero,
+ * except for the dirty bytes that are already in the cache.
+ *
+ * @param name checkpoint file name
+ * @param warm true for a warm start, false for a full restore
+ */
+void readCheckpoint(const char *name, bool warm) {
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL) {
+        printf("Error opening '%s': %s\n", name, strerror(errno));
+        exit(1);
+    }
+
+    checkpoint_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+        printf("Error: '%s' is not a checkpoint\n", name);
+        exit(1);
+    }
+    if (header.set_bits != set_bits ||
+        header.associativity != associativity ||
+        header.block_bits != block_bits || header.index_func != index_func) {
+        printf("Error: checkpoint '%s' is for s=%ld E=%ld b=%ld x=%s\n",
+               name, header.set_bits, header.associativity, header.block_bits,
+               index_names[header.index_func & 3]);
+        exit(1);
+    }
+
+    unsigned long dirty_lines = 0;
+    for (long i = 0; i < set_number; i++) {
+        for (long j = 0; j < associativity; j++) {
+            cache_line *line = &cache[i][j];
+            unsigned char flags;
+            if (fread(&line->tag, sizeof(line->tag), 1, fp) != 1 ||
+                fread(&line->time, sizeof(line->time), 1, fp) != 1 ||
+                fread(&flags, 1, 1, fp) != 1) {
+                printf("Error: checkpoint '%s' is truncated\n", name);
+                exit(1);
+            }
+            line->valid = (flags & 1) != 0;
+            line->dirty = (flags & 2) != 0;
+            if (line->dirty)
+                dirty_lines++;
+        }
+    }
+    fclose(fp);
+
+    LRU_timer = header.LRU_timer;
+    if (warm) {
+        stats->dirty_bytes = dirty_lines * block_size;
+    } else {
+        *stats = header.stats;
+        trace_offset = header.trace_offset;
+        access_count = header.access_count;
+        in_roi = header.in_roi != 0;
+    }
+}
+
+/**
+ * @brief skip the part of the trace a restored checkpoint already simulated
+ *
+ * @param r     reader to advance
+ * @param trace trace file name for error messages
+ */
+void skipTrace(trace_reader_t *r, const char *trace) {
+    char buf[BUFSIZ];
+    unsigned long left = trace_offset;
+    while (left > 0) {
+        size_t len = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+        size_t n = readerRead(r, buf, len);
+        if (n == 0) {
+            printf("Error: checkpoint is past the end of '%s'\n", trace);
+            exit(1);
+        }
+        left -= n;
+    }
+}
+
+/** @brief Outcome of parsing one trace line */
+typedef enum {
+    PARSE_OK,      /*the line is a valid access or ROI marker*/
+    PARSE_BAD_OP,  /*the line does not start with S or L*/
+    PARSE_BAD_ARG, /*the address or size could not be read*/
+    PARSE_BAD_SIZE /*the size is greater than 64*/
+} parse_result_t;
+
+/**
+ * @brief parse one line of the trace, as returned by readerGetLine
+ *
+ * With -R, the trace may also hold the lines "roi_begin" and "roi_end",
+ * which mark the region of interest; without it they are invalid.
+ *
+ * @param linebuf   line to parse
+ * @param operation operation char: S for store, L for read
+ * @param address   address of the access
+ * @param size      size of the access
+ * @return          PARSE_OK, or what is wrong with the line
+ */
+parse_result_t parseLine(const char *linebuf, char *operation,
+                         unsigned long *address, unsigned long *size) {
+    /*with -R, ROI markers come out as the operations B and E*/
+    if (is_roi_mode && linebuf[0] == 'r') {
+        size_t len = strcspn(linebuf, "\r\n");
+        if (len == strlen("roi_begin") &&
+            strncmp(linebuf, "roi_begin", len) == 0)
+            *operation = 'B';
+        else if (len == strlen("roi_end") &&
+                 strncmp(linebuf, "roi_end", len) == 0)
+            *operation = 'E';
+        else
+            return PARSE_BAD_OP;
+        *address = 0;
+        *size = 0;
+        return PARSE_OK;
+    }
+
+    /*Check Invalid operation otherthan store or read*/
+    if (linebuf[0] != 'S' && linebuf[0] != 'L')
+        return PARSE_BAD_OP;
+
+    /*read operation, address, and size*/
+    *operation = linebuf[0];
+    int ret = sscanf(linebuf + 1, " %lx,%lu", address, size);
+
+    /*If the number of return value is not 2, meaning there is an error for
+     * reading files*/
+    if (ret != 2)
+        return PARSE_BAD_ARG;
+
+    /*The size should not greater than 64*/
+    if (*size > 64)
+        return PARSE_BAD_SIZE;
+    return PARSE_OK;
+}
+
+/**
+ * @brief report a line that parseLine rejected, and exit
+ *
+ * @param result what is wrong with the line
+ * @param first  first char of the line
+ */
+void parseError(parse_result_t result, char first) {
+    if (result == PARSE_BAD_OP) {
+        printf("%c\n", first);
+        printf("Invalid operation or address in trace file\n");
+    } else if (result == PARSE_BAD_ARG) {
+        printf("Error reading trace file\n");
+    } else {
+        printf("Invalid size\n");
+    }
+    exit(1);
+}
+
+/**
+ * @brief simulate one access, printing it first in verbose mode
+ *
+ * @param operation operation char: S for store, L for read
+ * @param address   address of the access
+ * @param size      size of the access
+ */
+void simulateAccess(char operation, unsigned long address,
+                    unsigned long size) {
+    if (operation == 'B' || operation == 'E') {
+        in_roi = (operation == 'B');
+        return;
+    }
+
+    /*enable verobase mode for debug using, show the each operatio hit, miss
+     * or eviction*/
+    if (is_v_mode)
+        printf("%c %lu, %lu ", operation, address, size);
+
+    if (!is_parse_only) {
+        if (is_filtering)
+            setCounting(isCounted(address));
+        unsigned long misses = stats->misses;
+        processData(operation, address);
+        if (is_timing)
+            timingAccess(address, stats->misses != misses);
+        access_count++;
+        if (is_tlb)
+            tlbAccess(address);
+        if (interval > 0)
+            intervalAccess(address);
+    }
+}
+
+/**
+ * @brief one access decoded by the parallel parser
+ */
+typedef struct {
+    unsigned long address; /*address of the access*/
+    unsigned char size;    /*size of the access, at most 64*/
+    char operation;        /*S for store, L for read*/
+} access_t;
+
+/**
+ * @brief one chunk of the trace, in a slot of the parallel parser's queue
+ *
+ * A chunk holds whole lines of text, and once decoded the accesses they
+ * make. Decoding stops at the first bad line, which is reported after the
+ * accesses before it have been simulated.
+ */
+typedef struct {
+    char *text;              /*lines of the chunk*/
+    size_t text_len;         /*number of bytes in text*/
+    access_t *accesses;      /*decoded accesses*/
+    size_t count;            /*number of decoded accesses*/
+    parse_result_t error;    /*PARSE_OK, or what is wrong with the bad line*/
+    char error_first;        /*first char of the bad line*/
+    bool parsed;             /*true once the chunk has been decoded*/
+} parse_slot_t;
+
+/**
+ * @brief bounded queue of chunks between the splitter, parsers and simulator
+ *
+ * Chunk number i lives in slots[i % nslots]. The main thread splits the
+ * input into chunks and simulates them in order; the parser threads take
+ * the chunks in order too, but decode them concurrently.
+ */
+typedef struct {
+    parse_slot_t *slots;    /*the queue*/
+    long nslots;            /*capacity of the queue*/
+    unsigned long filled;   /*number of chunks split so far*/
+    unsigned long taken;    /*number of chunks taken by a parser*/
+    bool done;              /*true once the whole input has been split*/
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} parse_queue_t;
+
+/**
+ * @brief decode the accesses of a chunk, the way the serial parser does
+ *
+ * Lines longer than LINELEN - 1 bytes are cut into several, like
+ * readerGetLine cuts them.
+ *
+ * @param slot chunk to decode
+ */
+void parseChunk(parse_slot_t *slot) {
+    char linebuf[LINELEN];
+    size_t pos = 0;
+    slot->count = 0;
+    slot->error = PARSE_OK;
+
+    while (pos < slot->text_len) {
+        size_t n = 0;
+        while (n + 1 < LINELEN && pos < slot->text_len) {
+            char c = slot->text[pos++];
+            linebuf[n++] = c;
+            if (c == '\n')
+                break;
+        }
+        linebuf[n] = '\0';
+
+        unsigned long address;
+        unsigned long size;
+        char operation;
+        parse_result_t result = parseLine(linebuf, &operation, &address,
+                                          &size);
+        if (result != PARSE_OK) {
+            slot->error = result;
+            slot->error_first = linebuf[0];
+            return;
+        }
+        access_t *a = &slot->accesses[slot->count++];
+        a->address = address;
+        a->size = (unsigned char)size;
+        a->operation = operation;
+    }
+}
+
+/**
+ * @brief parser thread: decode chunks in order until the input is split
+ */
+void *parserThread(void *arg) {
+    parse_queue_t *q = arg;
+    while (true) {
+        pthread_mutex_lock(&q->lock);
+        while (q->taken == q->filled && !q->done)
+            pthread_cond_wait(&q->cond, &q->lock);
+        if (q->taken == q->filled) {
+            pthread_mutex_unlock(&q->lock);
+            return NULL;
+        }
+        parse_slot_t *slot = &q->slots[q->taken++ % (unsigned long)q->nslots];
+        pthread_mutex_unlock(&q->lock);
+
+        parseChunk(slot);
+
+        pthread_mutex_lock(&q->lock);
+        slot->parsed = true;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+/**
+ * @brief split the next chunk of the input into a free slot
+ *
+ * The chunk ends at its last newline; the partial line after it starts
+ * the next chunk. A chunk without any newline is cut where it is full.
+ *
+ * @param r     reader to read from
+ * @param q     queue to fill
+ * @param carry partial line left over by the previous chunk
+ * @param carry_len number of bytes in carry
+ * @return      false once the whole input has been split
+ */
+bool splitChunk(trace_reader_t *r, parse_queue_t *q, char *carry,
+                size_t *carry_len) {
+    parse_slot_t *slot = &q->slots[q->filled % (unsigned long)q->nslots];
+    memcpy(slot->text, carry, *carry_len);
+    size_t len = *carry_len;
+    len += readerRead(r, slot->text + len, PARSE_CHUNK - len);
+    bool more = (len == PARSE_CHUNK);
+
+    size_t end = len;
+    if (more) {
+        while (end > 0 && slot->text[end - 1] != '\n')
+            end--;
+        if (end == 0)
+            end = len;
+    }
+    *carry_len = len - end;
+    memcpy(carry, slot->text + end, *carry_len);
+
+    pthread_mutex_lock(&q->lock);
+    slot->text_len = end;
+    slot->parsed = false;
+    if (end > 0)
+        q->filled++;
+    q->done = !more;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return more;
+}
+
+/**
+ * @brief process a trace, decoding it in parallel but simulating in order
+ *
+ * @param r        reader to read from
+ * @param nthreads number of parser threads
+ */
+void processParallel(trace_reader_t *r, long nthreads) {
+    parse_queue_t q;
+    pthread_t threads[MAX_PARSE_THREADS];
+    char *carry = malloc(PARSE_CHUNK);
+
+    memset(&q, 0, sizeof(q));
+    q.nslots = 2 * nthreads;
+    q.slots = calloc((size_t)q.nslots, sizeof(parse_slot_t));
+    if (carry == NULL || q.slots == NULL) {
+        printf("Failed to allocate memory\n");
+        exit(1);
+    }
+    for (long i = 0; i < q.nslots; i++) {
+        q.slots[i].text = malloc(PARSE_CHUNK);
+        q.slots[i].accesses =
+            malloc((PARSE_CHUNK / MIN_LINE + 1) * sizeof(access_t));
+        if (q.slots[i].text == NULL || q.slots[i].accesses == NULL) {
+            printf("Failed to allocate memory\n");
+            exit(1);
+        }
+    }
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.cond, NULL);
+    for (long i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, parserThread, &q) != 0) {
+            fprintf(stderr, "Error starting parser thread\n");
+            exit(1);
+        }
+    }
+
+    size_t carry_len = 0;
+    bool more = true;
+    for (unsigned long next = 0;; next++) {
+        /*keep the queue full, so the parsers never wait for the simulator*/
+        while (more && q.filled < next + (unsigned long)q.nslots)
+            more = splitChunk(r, &q, carry, &carry_len);
+        if (next == q.filled)
+            break;
+
+        parse_slot_t *slot = &q.slots[next % (unsigned long)q.nslots];
+        pthread_mutex_lock(&q.lock);
+        while (!slot->parsed)
+            pthread_cond_wait(&q.cond, &q.lock);
+        pthread_mutex_unlock(&q.lock);
+
+        for (size_t i = 0; i < slot->count; i++) {
+            access_t *a = &slot->accesses[i];
+            simulateAccess(a->operation, a->address, a->size);
+        }
+        if (slot->error != PARSE_OK)
+            parseError(slot->error, slot->error_first);
+        trace_offset += slot->text_len;
+        maybeCheckpoint();
+    }
+
+    for (long i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    for (long i = 0; i < q.nslots; i++) {
+        free(q.slots[i].text);
+        free(q.slots[i].accesses);
+    }
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.cond);
+    free(q.slots);
+    free(carry);
+}
+
+/** @brief Process a memory-access trace file.
+ *
+ * @param trace Name of the trace file to process, or "-" for standard input.
+ *              gzip, zstd and xz compressed traces are decoded on the fly.
+ *              With several parser threads, chunks of the trace are decoded
+ *              in parallel and simulated in their original order.
+ * @return 0 if successful, 1 if there were error
+ */
+int process_trace_file(const char *trace) {
+
+    trace_reader_t reader;
+    readerOpen(&reader, trace);
+    skipTrace(&reader, trace);
+    next_checkpoint = access_count + checkpoint_every;
+    int parse_error = 0;
+
+    long nthreads = parse_threads;
+    if (nthreads == 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > MAX_PARSE_THREADS)
+        nthreads = MAX_PARSE_THREADS;
+
+    if (nthreads > 1) {
+        processParallel(&reader, nthreads);
+        readerClose(&reader, trace);
+        return parse_error;
+    }
+
+    char linebuf[LINELEN];
+    while (readerGetLine(&reader, linebuf, LINELEN)) {
+        char operation;
+        unsigned long address;
+        unsigned long size;
+        parse_result_t result = parseLine(linebuf, &operation, &address,
+                                          &size);
+        if (result != PARSE_OK)
+            parseError(result, linebuf[0]);
+        simulateAccess(operation, address, size);
+        trace_offset += strlen(linebuf);
+        maybeCheckpoint();
+    }
+    readerClose(&reader, trace);
+    return parse_error;
+}
+
+/**
+ * @brief the index function named by the argument of -x, exiting if none is
+ *
+ * @param name name of the index function
+ */
+index_func_t parseIndexFunc(const char *name) {
+    for (int i = 0; i <= INDEX_SKEW; i++) {
+        if (strcmp(name, index_names[i]) == 0)
+            return (index_func_t)i;
+    }
+    printf("Error: unknown index function '%s'\n", name);
+    exit(1);
+}
+
+/**
+ * @brief print help message
+ */
+void printHelp(void) {
+    printf("Usage: ./csim [-v] [-P] [-j <n>] [-I <n> [-o <csv>]] "
+           "[-W <n>] [-R] [-a <lo>-<hi>]\n"
+           "              [-x <index>] [-T <tlb>] [-m <timing>] [-e <log>] "
+           "[-c <ckpt> [-n <n>]]\n"
+           "              [-r <ckpt> | -w <ckpt>] "
+           "-s <s> -b <b> -E <E> -t <trace>\n");
+    printf("       ./csim -h\n");
+    printf("    -h          Print this help message and exit\n");
+    printf("    -v          Verbose mode: report effects of each memory "
+           "operation\n");
+    printf("    -P          Parse the trace without simulating it\n");
+    printf("    -j <n>      Parse with n threads, 0 for one per core (default: "
+           "1, at most %d)\n",
+           MAX_PARSE_THREADS);
+    printf("    -I <n>      Report statistics and phases of every n "
+           "accesses as CSV\n");
+    printf("    -o <csv>    Write the CSV of -I to a file instead of "
+           "stdout\n");
+    printf("    -W <n>      Warm the cache up with the first n accesses, "
+           "without counting them\n");
+    printf("    -R          Count only the accesses between roi_begin and "
+           "roi_end lines\n");
+    printf("    -a <lo>-<hi> Count only the accesses to addresses in "
+           "[lo, hi), in hex\n");
+    printf("    -x <index>  Set index function: bits (default), xor, prime "
+           "or skew\n");
+    printf("    -T <tlb>    Also simulate a two-level TLB, e.g. "
+           "page=2m,l1=32x4,l2=1024x8\n");
+    printf("    -m <timing> Also time a non-blocking cache, e.g. "
+           "mshrs=8,latency=100,hit=4,issue=1\n");
+    printf("    -e <log>    Write a binary record of every access to log, "
+           "see csim-log\n");
+    printf("    -c <ckpt>   Save the simulator state to ckpt periodically "
+           "and at the end\n");
+    printf("    -n <n>      Save a checkpoint every n accesses (default "
+           "%lu)\n",
+           CHECKPOINT_EVERY);
+    printf("    -r <ckpt>   Resume the simulation of the trace saved in "
+           "ckpt\n");
+    printf("    -w <ckpt>   Start with the cache contents saved in ckpt, "
+           "maybe of another\n"
+           "                trace\n");
+    printf("    -s <s>      Number of set index bits (there are 2**s sets)\n");
+    printf("    -b <b>      Number of block bits (there are 2**b blocks)\n");
+    printf("    -E <E>      Number of lines per set (associativity)\n");
+    printf("    -t <trace>  File name of the memory trace to process\n");
+    printf("                ('-' reads standard input; gzip, zstd and xz\n");
+    printf("                compressed traces are decoded automatically)\n\n");
+    printf("The -s, -b, -E, and -t options must be supplied for all "
+           "simulations.\n");
+}
+
+/**
+ * @brief main function
+ *
+ * @param [in] argv Command Line argument,  [-v] -s <s> -E <E> -b <b> -t <trace>
+ */
+int main(int argc, char *argv[]) {
+    int opt;
+    char *restore_file = NULL; /*checkpoint to start from, or NULL*/
+    bool is_warm_start = false; /*only load the cache contents from it*/
+    char *event_file = NULL;    /*event log to write, or NULL*/
+    /*read commamd line argument, -s for set bits, -E for asssociativity,
+     -b for block bits, -t for file name*/
+    while ((opt = getopt(argc, argv,
+                         "vhPj:I:o:W:Ra:x:T:m:e:c:n:r:w:s:E:b:t:")) != -1) {
+        switch (opt) {
+        case 'v':
+            printf("This is v mode\n");
+            is_v_mode = true;
+
+            break;
+
+        case 'h':
+            printHelp();
+            break;
+
+        case 'P':
+            is_parse_only = true;
+            break;
+
+        case 'j':
+            parse_threads = strtol(optarg, NULL, DECIMAL_BASE);
+            if (parse_threads < 0) {
+                printf("Error: -j needs 0 or more threads\n");
+                exit(1);
+            }
+            break;
+
+        case 'I':
+            interval = strtoul(optarg, NULL, DECIMAL_BASE);
+            if (interval == 0) {
+                printf("Error: -I needs at least one access per window\n");
+                exit(1);
+            }
+            break;
+
+        case 'o':
+            interval_fp = fopen(optarg, "w");
+            if (interval_fp == NULL) {
+                printf("Error opening '%s': %s\n", optarg, strerror(errno));
+                exit(1);
+            }
+            break;
+
+        case 'W':
+            warmup = strtoul(optarg, NULL, DECIMAL_BASE);
+            break;
+
+        case 'R':
+            is_roi_mode = true;
+            break;
+
+        case 'a':
+            if (sscanf(optarg, "%lx-%lx", &range_lo, &range_hi) != 2 ||
+                range_lo >= range_hi) {
+                printf("Error: -a needs a range like 1000-2000\n");
+                exit(1);
+            }
+            is_range = true;
+            break;
+
+        case 'x':
+            index_func = parseIndexFunc(optarg);
+            break;
+
+        case 'T':
+            parseTlbSpec(optarg);
+            break;
+
+        case 'm':
+            parseTimingSpec(optarg);
+            break;
+
+        case 'e':
+            event_file = optarg;
+            break;
+
+        case 'c':
+            checkpoint_file = optarg;
+            break;
+
+        case 'n':
+            checkpoint_every = strtoul(optarg, NULL, DECIMAL_BASE);
+            if (checkpoint_every == 0) {
+                printf("Error: -n needs at least one access\n");
+                exit(1);
+            }
+            break;
+
+        case 'r':
+        case 'w':
+            restore_file = optarg;
+            is_warm_start = (opt == 'w');
+            break;
+
+        case 's':
+            set_bits = strtol(optarg, NULL, DECIMAL_BASE);
+            break;
+
+        case 'E':
+            associativity = strtol(optarg, NULL, DECIMAL_BASE);
+            break;
+
+        case 'b':
+            block_bits = strtol(optarg, NULL, DECIMAL_BASE);
+
+            break;
+
+        case 't':
+            file_name = optarg;
+            break;
+
+        case ':':
+            printf("Mandatory arguments missing or zero.\n");
+            printHelp();
+            exit(1);
+            break;
+
+        case '?':
+            printf("Error while parsing arguments.");
+            printHelp();
+            exit(1);
+
+            break;
+        }
+    }
+
+    /*associativity and file name cannot be zero or null, exit the program if it
+     * does not meet the requirment*/
+    if (associativity == 0 || file_name == NULL) {
+        printf("Mandatory arguments missing or zero.\n");
+        printHelp();
+        exit(1);
+    }
+
+    /*All set_bits, block bits, should not be negative,
+    and the number of set_block and block bits cannot be greater than address,
+    and there must be a tag bits */
+    if (set_bits < 0 || block_bits < 0 || set_bits + block_bits > 63) {
+        printf("Error: s + b is too large (s = %lu, b = %lu)\n", set_bits,
+               block_bits);
+        exit(1);
+    }
+    /*associativity can not be less 1*/
+    if (associativity < 1) {
+
+        printf("Failed to allocate memory\n");
+        exit(1);
+    }
+    /*the TLB is not saved in checkpoints, so a restored run would mix
+     whole-trace cache totals with TLB counts of a part of it*/
+    if (is_tlb && (checkpoint_file != NULL || restore_file != NULL)) {
+        printf("Error: -T cannot be used with -c, -r or -w\n");
+        exit(1);
+    }
+    /*nor are the MSHRs and the clock of the timing mode; a warm start
+     begins with no miss in flight, which is fine*/
+    if (is_timing &&
+        (checkpoint_file != NULL || (restore_file != NULL && !is_warm_start))) {
+        printf("Error: -m cannot be used with -c or -r\n");
+        exit(1);
+    }
+    /*Do the simulation*/
+
+    initCache();
     initStats();
+    is_filtering = warmup > 0 || is_roi_mode || is_range;
+    memset(&excluded, 0, sizeof(excluded));
+    if (is_tlb)
+        initTlb();
+    if (is_timing)
+        initTiming();
+    if (event_file != NULL)
+        initEvents(event_file);
+    if (restore_file != NULL)
+        readCheckpoint(restore_file, is_warm_start);
+    if (interval > 0) {
+        if (interval_fp == NULL)
+            interval_fp = stdout;
+        initInterval();
+        /*a restored run goes on from the checkpoint's totals, with a first
+         window that ends where the uninterrupted run's would, since the
+         checkpoint need not fall on a window boundary*/
+        window.start = *stats;
+        window.first = access_count;
+        window.number = access_count / interval;
+        window.length = interval - access_count % interval;
+    }
     process_trace_file(file_name);
-
+    if (event_fp != NULL)
+        closeEvents();
+    if (interval > 0)
+        freeInterval();
+    if (checkpoint_file != NULL)
+        writeCheckpoint();
+
+    countedStats(stats);
     printSummary(stats);
+    if (is_tlb)
+        printTlb(stats);
+    if (is_timing)
+        printTiming();
 
     freeCache();
     freeStats();
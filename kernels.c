@@ -0,0 +1,196 @@
+/**
+ * @file kernels.c
+ * @brief Kernels other than transpose, whose cache behaviour is evaluated
+ *        like that of the transpose functions
+ *
+ * Each kernel has the prototype
+ *   void kernel(size_t M, size_t N, const double *in, const void *aux,
+ *               double *out);
+ * and is registered with registerKernel() along with its family, which says
+ * what the operands hold (see kernel_family_t in cachelab.h):
+ *
+ *   @param[in]  M    Width of in
+ *   @param[in]  N    Height of in
+ *   @param[in]  in   Input matrix, N x M, row-major
+ *   @param[in]  aux  Second input of the family, or NULL
+ *   @param[out] out  Result of the family
+ *
+ * The kernels are traced by tracegen-ct -k and scored by test-kernels, with
+ * the same cache parameters and cycle counts as the transpose functions.
+ * They must not write to in or aux, nor outside of out.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cachelab.h"
+
+/** @brief Side of the tiles of the blocked kernels */
+#define KERNEL_BLOCK 32
+
+/**
+ * @brief out = in * aux, one dot product per element of out
+ *
+ * Walks down a column of aux for every element, so each access to aux is
+ * to another cache block once the rows are longer than a block.
+ */
+static void gemm_naive(size_t M, size_t N, const double *in, const void *aux,
+                       double *out) {
+    const double *b = aux;
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < N; j++) {
+            double sum = 0;
+            for (size_t k = 0; k < M; k++) {
+                sum += in[i * M + k] * b[k * N + j];
+            }
+            out[i * N + j] = sum;
+        }
+    }
+}
+
+/**
+ * @brief out = in * aux, working through KERNEL_BLOCK tiles
+ *
+ * The i-k-j order inside a tile streams along the rows of aux and out, and
+ * the tiles keep the rows of aux in use small enough to stay in the cache.
+ */
+static void gemm_blocked(size_t M, size_t N, const double *in, const void *aux,
+                         double *out) {
+    const double *b = aux;
+    memset(out, 0, N * N * sizeof(double));
+    for (size_t ii = 0; ii < N; ii += KERNEL_BLOCK) {
+        size_t iend = ii + KERNEL_BLOCK < N ? ii + KERNEL_BLOCK : N;
+        for (size_t kk = 0; kk < M; kk += KERNEL_BLOCK) {
+            size_t kend = kk + KERNEL_BLOCK < M ? kk + KERNEL_BLOCK : M;
+            for (size_t jj = 0; jj < N; jj += KERNEL_BLOCK) {
+                size_t jend = jj + KERNEL_BLOCK < N ? jj + KERNEL_BLOCK : N;
+                for (size_t i = ii; i < iend; i++) {
+                    for (size_t k = kk; k < kend; k++) {
+                        double a = in[i * M + k];
+                        for (size_t j = jj; j < jend; j++) {
+                            out[i * N + j] += a * b[k * N + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes one element of the 5-point stencil
+ */
+static void stencil_point(size_t M, size_t N, const double *in, double *out,
+                          size_t i, size_t j) {
+    const double *c = &in[i * M + j];
+    if (i == 0 || j == 0 || i == N - 1 || j == M - 1) {
+        out[i * M + j] = c[0];
+    } else {
+        out[i * M + j] = 4 * c[0] - c[-1] - c[1] - c[-(long)M] - c[M];
+    }
+}
+
+/**
+ * @brief 5-point stencil along the rows, reusing the three rows in use
+ */
+static void stencil_rows(size_t M, size_t N, const double *in, const void *aux,
+                         double *out) {
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < M; j++) {
+            stencil_point(M, N, in, out, i, j);
+        }
+    }
+}
+
+/**
+ * @brief 5-point stencil down the columns, for comparison
+ */
+static void stencil_cols(size_t M, size_t N, const double *in, const void *aux,
+                         double *out) {
+    for (size_t j = 0; j < M; j++) {
+        for (size_t i = 0; i < N; i++) {
+            stencil_point(M, N, in, out, i, j);
+        }
+    }
+}
+
+/**
+ * @brief Sums each row of in, streaming through it once
+ */
+static void row_sum(size_t M, size_t N, const double *in, const void *aux,
+                    double *out) {
+    for (size_t i = 0; i < N; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < M; j++) {
+            sum += in[i * M + j];
+        }
+        out[i] = sum;
+    }
+}
+
+/**
+ * @brief Sums each column of in, walking down one column at a time
+ */
+static void col_sum_strided(size_t M, size_t N, const double *in,
+                            const void *aux, double *out) {
+    for (size_t j = 0; j < M; j++) {
+        double sum = 0;
+        for (size_t i = 0; i < N; i++) {
+            sum += in[i * M + j];
+        }
+        out[j] = sum;
+    }
+}
+
+/**
+ * @brief Sums each column of in, adding the rows of in to out in turn
+ */
+static void col_sum_rows(size_t M, size_t N, const double *in,
+                         const void *aux, double *out) {
+    memset(out, 0, M * sizeof(double));
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < M; j++) {
+            out[j] += in[i * M + j];
+        }
+    }
+}
+
+/**
+ * @brief out[k] = in[aux[k]], reading in at random
+ */
+static void gather(size_t M, size_t N, const double *in, const void *aux,
+                   double *out) {
+    const uint32_t *idx = aux;
+    for (size_t k = 0; k < M * N; k++) {
+        out[k] = in[idx[k]];
+    }
+}
+
+/**
+ * @brief out[aux[k]] = in[k], writing out at random
+ */
+static void scatter(size_t M, size_t N, const double *in, const void *aux,
+                    double *out) {
+    const uint32_t *idx = aux;
+    for (size_t k = 0; k < M * N; k++) {
+        out[idx[k]] = in[k];
+    }
+}
+
+/**
+ * @brief Registers the kernels with the driver
+ *
+ * Like registerFunctions(), this is called before any kernel is evaluated.
+ * Kernel i is traced with tracegen-ct -k i.
+ */
+void registerKernels(void) {
+    registerKernel(KERNEL_GEMM, gemm_naive, "Dot-product matrix multiply");
+    registerKernel(KERNEL_GEMM, gemm_blocked, "Blocked matrix multiply");
+    registerKernel(KERNEL_STENCIL, stencil_rows, "5-point stencil by rows");
+    registerKernel(KERNEL_STENCIL, stencil_cols, "5-point stencil by columns");
+    registerKernel(KERNEL_ROW_SUM, row_sum, "Row sums");
+    registerKernel(KERNEL_COL_SUM, col_sum_strided, "Column sums by columns");
+    registerKernel(KERNEL_COL_SUM, col_sum_rows, "Column sums by rows");
+    registerKernel(KERNEL_GATHER, gather, "Gather through a permutation");
+    registerKernel(KERNEL_SCATTER, scatter, "Scatter through a permutation");
+}
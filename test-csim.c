@@ -7,6 +7,8 @@
  * instructors (csim-ref).
  */
 
+#define _XOPEN_SOURCE 700 // mkdtemp, clock_gettime
+
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
@@ -17,6 +19,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cachelab.h"
@@ -56,15 +59,39 @@ static const trace_info_t TRACE_INFO[N] = {
     {.s = 5, .E = 1, .b = 5, .weight = 2, .filename = TRACES_DIR "long.trace"},
 };
 
+/** @brief Trace resumed from a checkpoint by the checkpoint check (-c) */
+#define CHECKPOINT_TRACE TRACES_DIR "long.trace"
+
+/** @brief Accesses simulated before the checkpoint of the check, which
+ *         falls inside a window */
+#define CHECKPOINT_ACCESSES 105000
+
+/** @brief Accesses per -I window in the checkpoint check */
+#define CHECKPOINT_WINDOW 10000
+
 static int num_runs = 0; // used to randomize input to students' csim
 
+/** @brief Directory holding csim, csim-ref and the traces, relative to cwd */
+static const char *tool_dir = ".";
+
+/** @brief Outcome of running one test case */
+typedef struct {
+    bool success;            /* whether both simulators ran */
+    csim_stats_t ref_stats;  /* statistics of the reference simulator */
+    csim_stats_t test_stats; /* statistics of the simulator being tested */
+    double seconds;          /* wall time of the test case */
+} trace_result_t;
+
 /*
  * usage - Prints usage info
  */
 static void usage(char *argv[]) {
-    printf("Usage: %s [-h]\n", argv[0]);
+    printf("Usage: %s [-h] [-c] [-j <n>]\n", argv[0]);
     printf("Options:\n");
-    printf("  -h    Print this help message.\n");
+    printf("  -h      Print this help message.\n");
+    printf("  -c      Also check that csim -r resumes -I windows like an "
+           "uninterrupted run\n");
+    printf("  -j <n>  Run n test cases concurrently (0: all at once)\n");
 }
 
 /**
@@ -81,15 +108,17 @@ static void sigalrm_handler(int signum) {
 /**
  * @brief Runs a cache simulation and collects the resulting statistics.
  *
- * @param[in]  cmd    The command used to invoke csim
- * @param[out] stats  The statistics collected from this simulation run
+ * @param[in]  cmd          The command used to invoke csim
+ * @param[in]  results_file The file the simulator stores its summary in
+ * @param[out] stats        The statistics collected from this simulation run
  *
  * @return false if any problems, true if OK.
  */
-static bool run_csim(const char *cmd, csim_stats_t *stats) {
+static bool run_csim(const char *cmd, const char *results_file,
+                     csim_stats_t *stats) {
     int status;
 
-    status = unlink(".csim_results");
+    status = unlink(results_file);
     if (status < 0 && errno != ENOENT) {
         fprintf(stderr, "Error removing old simulation results: %s\n",
                 strerror(errno));
@@ -108,13 +137,13 @@ static bool run_csim(const char *cmd, csim_stats_t *stats) {
     }
 
     /* Get the results from the simulator */
-    bool success = loadSummary(stats);
+    bool success = loadSummaryFile(results_file, stats);
     if (!success) {
         fprintf(stderr, "Error: Results for csim not found. Use the "
                         "printSummary() function\n");
     }
 
-    status = unlink(".csim_results");
+    status = unlink(results_file);
     (void)status;
 
     return success;
@@ -135,11 +164,15 @@ static bool run_csim(const char *cmd, csim_stats_t *stats) {
 static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
                      csim_stats_t *test_stats) {
     char cmd[MAX_STR];
+    char trace[MAX_STR / 2];
+
+    snprintf(trace, sizeof(trace), "%s/%s", tool_dir, info->filename);
 
     /* Run the reference simulator */
-    sprintf(cmd, "./csim-ref -s %d -E %d -b %d -t %s > /dev/null", info->s,
-            info->E, info->b, info->filename);
-    if (!run_csim(cmd, ref_stats)) {
+    snprintf(cmd, sizeof(cmd),
+             "%s/csim-ref -s %d -E %d -b %d -t %s > /dev/null", tool_dir,
+             info->s, info->E, info->b, trace);
+    if (!run_csim(cmd, CSIM_RESULTS_FILE, ref_stats)) {
         fprintf(stderr, "Running reference simulator failed: '%s'\n", cmd);
         fprintf(stderr, "\n");
         return false;
@@ -150,26 +183,30 @@ static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
      * that students don't hardcode argument parsing */
     switch (num_runs % 4) {
     case 0:
-        sprintf(cmd, "./csim -b %d -s %d -t %s -E %d > /dev/null", info->b,
-                info->s, info->filename, info->E);
+        snprintf(cmd, sizeof(cmd),
+                 "%s/csim -b %d -s %d -t %s -E %d > /dev/null", tool_dir,
+                 info->b, info->s, trace, info->E);
         break;
     case 1:
-        sprintf(cmd, "./csim -t %s -E %d -s %d -b %d > /dev/null",
-                info->filename, info->E, info->s, info->b);
+        snprintf(cmd, sizeof(cmd),
+                 "%s/csim -t %s -E %d -s %d -b %d > /dev/null", tool_dir,
+                 trace, info->E, info->s, info->b);
         break;
     case 2:
-        sprintf(cmd, "./csim -E %d -b %d -t %s -s %d > /dev/null", info->E,
-                info->b, info->filename, info->s);
+        snprintf(cmd, sizeof(cmd),
+                 "%s/csim -E %d -b %d -t %s -s %d > /dev/null", tool_dir,
+                 info->E, info->b, trace, info->s);
         break;
     case 3:
-        sprintf(cmd, "./csim -s %d -E %d -b %d -t %s > /dev/null", info->s,
-                info->E, info->b, info->filename);
+        snprintf(cmd, sizeof(cmd),
+                 "%s/csim -s %d -E %d -b %d -t %s > /dev/null", tool_dir,
+                 info->s, info->E, info->b, trace);
         break;
     }
 
     num_runs = num_runs + 1;
 
-    if (!run_csim(cmd, test_stats)) {
+    if (!run_csim(cmd, summaryFileName(), test_stats)) {
         fprintf(stderr, "Running test simulator failed: '%s'\n", cmd);
         fprintf(stderr, "\n");
         return false;
@@ -178,6 +215,98 @@ static bool runtrace(const trace_info_t *info, csim_stats_t *ref_stats,
     return true;
 }
 
+/**
+ * @brief Runs one test case and measures its wall time
+ */
+static void run_case(int i, trace_result_t *result) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result->success =
+        runtrace(&TRACE_INFO[i], &result->ref_stats, &result->test_stats);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->seconds = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Runs all test cases in up to max_workers worker processes
+ *
+ * Every worker runs in a private directory with its own .csim_results file,
+ * since csim-ref always uses that name, so concurrent simulations never
+ * collide.
+ * Results are sent back through one pipe per test case.
+ */
+static void run_cases_parallel(trace_result_t results[N], int max_workers) {
+    int result_fds[N];
+    int running = 0;
+    int next = 0;
+
+    while (next < N || running > 0) {
+        if (next < N && running < max_workers) {
+            int i = next++;
+            int fds[2];
+            result_fds[i] = -1;
+            if (pipe(fds) < 0) {
+                fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+                continue;
+            }
+
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0) {
+                fprintf(stderr, "Error forking: %s\n", strerror(errno));
+                close(fds[0]);
+                close(fds[1]);
+                continue;
+            }
+
+            if (pid == 0) {
+                char dir[] = ".test-csim.XXXXXX";
+                close(fds[0]);
+                if (mkdtemp(dir) == NULL || chdir(dir) < 0) {
+                    fprintf(stderr, "Error creating worker directory: %s\n",
+                            strerror(errno));
+                } else {
+                    /* A shared CSIM_RESULTS file would race, use our own */
+                    (void)unsetenv(CSIM_RESULTS_ENV);
+                    tool_dir = "..";
+                    num_runs = i;
+                    run_case(i, &results[i]);
+                    if (chdir("..") == 0) {
+                        (void)rmdir(dir);
+                    }
+                }
+                ssize_t res = write(fds[1], &results[i], sizeof(results[i]));
+                (void)res;
+                _exit(0);
+            }
+
+            close(fds[1]);
+            result_fds[i] = fds[0];
+            running++;
+            continue;
+        }
+        if (wait(NULL) < 0) {
+            break;
+        }
+        running--;
+    }
+
+    for (int i = 0; i < N; i++) {
+        if (result_fds[i] < 0) {
+            continue;
+        }
+        trace_result_t result;
+        if (read(result_fds[i], &result, sizeof(result)) ==
+            (ssize_t)sizeof(result)) {
+            results[i] = result;
+        }
+        close(result_fds[i]);
+    }
+}
+
 /**
  * @brief Counts the number of matching fields in two csim_stats_t structs
  */
@@ -196,7 +325,7 @@ static int count_matches(const csim_stats_t *a, const csim_stats_t *b) {
  */
 static void print_trace_results(int points, const trace_info_t *info,
                                 const csim_stats_t *test_stats,
-                                const csim_stats_t *ref_stats) {
+                                const csim_stats_t *ref_stats, double seconds) {
     char buf[MAX_STR];
     sprintf(buf, "(%2d,%4d,%1d)", info->s, info->E, info->b);
     printf("%6d %8s", points, buf);
@@ -206,35 +335,47 @@ static void print_trace_results(int points, const trace_info_t *info,
     printf("%8ld%8ld%8ld%8ld%8ld", ref_stats->hits, ref_stats->misses,
            ref_stats->evictions, ref_stats->dirty_bytes,
            ref_stats->dirty_evictions);
-    printf("  %s\n", info->filename);
+    printf("%8.3f  %s\n", seconds, info->filename);
 }
 
 /**
  * @brief Checks the student's test simulator for correctness by
  *        comparing its results to the reference simulator.
+ *
+ * @param[in] max_workers Number of test cases to run concurrently
  */
-static void test_csim(void) {
+static void test_csim(int max_workers) {
     /* Output results */
-    csim_stats_t ref_stats[N];
-    csim_stats_t test_stats[N];
+    trace_result_t results[N];
     int points[N];
     int total_points = 0;
 
     /* Initialize arrays */
     for (int i = 0; i < N; i++) {
+        csim_stats_t *ref_stats = &results[i].ref_stats;
+        csim_stats_t *test_stats = &results[i].test_stats;
         points[i] = 0;
-        ref_stats[i].hits = ref_stats[i].misses = ref_stats[i].evictions =
-            ref_stats[i].dirty_bytes = ref_stats[i].dirty_evictions = ULONG_MAX;
-        test_stats[i].hits = test_stats[i].misses = test_stats[i].evictions =
-            test_stats[i].dirty_bytes = test_stats[i].dirty_evictions =
-                ULONG_MAX;
+        results[i].success = false;
+        results[i].seconds = 0.0;
+        ref_stats->hits = ref_stats->misses = ref_stats->evictions =
+            ref_stats->dirty_bytes = ref_stats->dirty_evictions = ULONG_MAX;
+        test_stats->hits = test_stats->misses = test_stats->evictions =
+            test_stats->dirty_bytes = test_stats->dirty_evictions = ULONG_MAX;
     }
 
     /* Run the individual tests */
+    if (max_workers > 1) {
+        run_cases_parallel(results, max_workers);
+    } else {
+        for (int i = 0; i < N; i++) {
+            run_case(i, &results[i]);
+        }
+    }
+
     for (int i = 0; i < N; i++) {
-        bool success = runtrace(&TRACE_INFO[i], &ref_stats[i], &test_stats[i]);
-        if (success) {
-            points[i] = count_matches(&ref_stats[i], &test_stats[i]) *
+        if (results[i].success) {
+            points[i] = count_matches(&results[i].ref_stats,
+                                      &results[i].test_stats) *
                         TRACE_INFO[i].weight;
         }
         total_points += points[i];
@@ -242,13 +383,13 @@ static void test_csim(void) {
 
     /* Display a summary of results */
     printf("%42s%45s\n", "Your simulator", "Reference simulator");
-    printf("%6s%12s%8s%8s%8s%8s%8s%8s%8s%8s%8s%8s\n", "Points", "( s,   E,b)",
-           "Hits", "Misses", "Evicts", "D_Cache", "D_Evict", "Hits", "Misses",
-           "Evicts", "D_Cache", "D_Evict");
+    printf("%6s%12s%8s%8s%8s%8s%8s%8s%8s%8s%8s%8s%8s\n", "Points",
+           "( s,   E,b)", "Hits", "Misses", "Evicts", "D_Cache", "D_Evict",
+           "Hits", "Misses", "Evicts", "D_Cache", "D_Evict", "Secs");
 
     for (int i = 0; i < N; i++) {
-        print_trace_results(points[i], &TRACE_INFO[i], &test_stats[i],
-                            &ref_stats[i]);
+        print_trace_results(points[i], &TRACE_INFO[i], &results[i].test_stats,
+                            &results[i].ref_stats, results[i].seconds);
     }
 
     printf("%6d\n", total_points);
@@ -257,15 +398,179 @@ static void test_csim(void) {
     printf("\nTEST_CSIM_RESULTS=%d\n", total_points);
 }
 
+/**
+ * @brief Runs one csim command of the checkpoint check
+ *
+ * @return false if the command failed, true if OK.
+ */
+static bool run_check_cmd(const char *cmd) {
+    int status = system(cmd);
+    if (status < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Checkpoint check: '%s' failed\n", cmd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the statistics of one window from a -I CSV file
+ *
+ * Copies the fields from window to miss_rate of the given window, leaving
+ * out the phase columns.
+ *
+ * @param[in]  file_name The CSV file to read
+ * @param[in]  window    Index of the window, 0 for the first one
+ * @param[out] fields    Where to store the fields, MAX_STR bytes
+ *
+ * @return false if the window is missing, true if OK.
+ */
+static bool read_window(const char *file_name, int window, char *fields) {
+    char line[MAX_STR];
+    bool found = false;
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        printf("Checkpoint check: cannot open %s\n", file_name);
+        return false;
+    }
+
+    /* Skip the header line and the windows before */
+    for (int i = 0; i <= window + 1 && fgets(line, sizeof(line), fp); i++) {
+        found = (i == window + 1);
+    }
+    fclose(fp);
+    if (!found) {
+        printf("Checkpoint check: %s has no window %d\n", file_name, window);
+        return false;
+    }
+
+    char *end = line;
+    for (int i = 0; end != NULL && i < 10; i++) {
+        end = strchr(i == 0 ? end : end + 1, ',');
+    }
+    if (end == NULL) {
+        printf("Checkpoint check: bad line in %s: %s", file_name, line);
+        return false;
+    }
+    *end = '\0';
+    strcpy(fields, line);
+    return true;
+}
+
+/**
+ * @brief Checks that csim resumes the interval mode from a checkpoint
+ *
+ * Saves a checkpoint after the first CHECKPOINT_ACCESSES accesses of a
+ * trace, resumes the trace from it with -I, and compares the first full
+ * window of the resumed run, number included, with the same window of a
+ * run without a checkpoint.
+ *
+ * @return false if the check failed, true if OK.
+ */
+static bool check_checkpoint(void) {
+    char dir[] = ".test-csim.XXXXXX";
+    char trace[MAX_STR / 4];
+    char prefix[MAX_STR / 4];
+    char full[MAX_STR / 4];
+    char resumed[MAX_STR / 4];
+    char cmd[MAX_STR];
+    char full_fields[MAX_STR];
+    char resumed_fields[MAX_STR];
+    bool ok = false;
+
+    if (mkdtemp(dir) == NULL) {
+        printf("Checkpoint check: cannot create %s: %s\n", dir,
+               strerror(errno));
+        return false;
+    }
+    snprintf(trace, sizeof(trace), "%s/%s", tool_dir, CHECKPOINT_TRACE);
+    snprintf(prefix, sizeof(prefix), "%s/prefix.trace", dir);
+    snprintf(full, sizeof(full), "%s/full.csv", dir);
+    snprintf(resumed, sizeof(resumed), "%s/resumed.csv", dir);
+
+    /* Cut the trace after the accesses the checkpoint covers */
+    FILE *in = fopen(trace, "r");
+    FILE *out = fopen(prefix, "w");
+    char line[MAX_STR];
+    for (int i = 0; in != NULL && out != NULL && i < CHECKPOINT_ACCESSES &&
+                    fgets(line, sizeof(line), in) != NULL;
+         i++) {
+        fputs(line, out);
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out == NULL || fclose(out) != 0) {
+        printf("Checkpoint check: cannot write %s\n", prefix);
+        goto cleanup;
+    }
+
+    snprintf(cmd, sizeof(cmd),
+             "%s=%s/results %s/csim -j 1 -s 5 -E 1 -b 5 -I %d -o %s -t %s "
+             "> /dev/null",
+             CSIM_RESULTS_ENV, dir, tool_dir, CHECKPOINT_WINDOW, full, trace);
+    if (!run_check_cmd(cmd)) {
+        goto cleanup;
+    }
+    snprintf(cmd, sizeof(cmd),
+             "%s=%s/results %s/csim -j 1 -s 5 -E 1 -b 5 -c %s/ckpt -t %s "
+             "> /dev/null",
+             CSIM_RESULTS_ENV, dir, tool_dir, dir, prefix);
+    if (!run_check_cmd(cmd)) {
+        goto cleanup;
+    }
+    snprintf(cmd, sizeof(cmd),
+             "%s=%s/results %s/csim -j 1 -s 5 -E 1 -b 5 -r %s/ckpt -I %d "
+             "-o %s -t %s > /dev/null",
+             CSIM_RESULTS_ENV, dir, tool_dir, dir, CHECKPOINT_WINDOW, resumed,
+             trace);
+    if (!run_check_cmd(cmd)) {
+        goto cleanup;
+    }
+
+    /* The resumed run first finishes the window the checkpoint fell in */
+    if (read_window(full, CHECKPOINT_ACCESSES / CHECKPOINT_WINDOW + 1,
+                    full_fields) &&
+        read_window(resumed, 1, resumed_fields)) {
+        ok = strcmp(full_fields, resumed_fields) == 0;
+        printf("\nCheckpoint check: %s\n", ok ? "OK" : "FAILED");
+        if (!ok) {
+            printf("  without checkpoint: %s\n", full_fields);
+            printf("  resumed:            %s\n", resumed_fields);
+        }
+    }
+
+cleanup:
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) {
+        printf("Checkpoint check: cannot remove %s\n", dir);
+    }
+    return ok;
+}
+
 /**
  * @brief Main routine
  */
 int main(int argc, char *argv[]) {
     int c;
+    int max_workers = 1;
+    bool checkpoint = false;
 
     /* Parse command line args */
-    while ((c = getopt(argc, argv, "h")) != -1) {
+    while ((c = getopt(argc, argv, "hcj:")) != -1) {
         switch (c) {
+        case 'j':
+            max_workers = atoi(optarg);
+            if (max_workers == 0) {
+                max_workers = N;
+            }
+            if (max_workers < 1) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'c':
+            checkpoint = true;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -285,7 +590,12 @@ int main(int argc, char *argv[]) {
     alarm(20);
 
     /* Evaluate the student's cache simulator for correctness */
-    test_csim();
+    test_csim(max_workers);
+
+    /* Not scored: csim only needs -r and -I for this check */
+    if (checkpoint && !check_checkpoint()) {
+        exit(1);
+    }
 
     exit(0);
 }
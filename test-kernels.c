@@ -0,0 +1,278 @@
+/**
+ * @file test-kernels.c
+ * @brief Checks the kernels of kernels.c and scores their cache behaviour
+ *
+ * Like test-trans, this program has tracegen-ct validate each kernel and
+ * trace its memory accesses, then simulates the trace on the test cache or
+ * the Haswell L1 cache and counts clock cycles the same way. The trace is
+ * simulated in-process, with the same LRU policy as csim-ref.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h> // for WEXITSTATUS
+#include <unistd.h>
+
+#include "cachelab.h"
+
+#define CMD_BUFSIZE 400
+#define FILENAME_BUFSIZE 255
+
+/* Globals set on the command line */
+static size_t M = 0;
+static size_t N = 0;
+
+/** @brief Geometry of a simulated cache */
+typedef struct {
+    unsigned int s; /* log2 of the number of sets */
+    unsigned int E; /* associativity */
+    unsigned int b; /* log2 of the block size */
+} cache_config_t;
+
+/**
+ * @brief Calculates the number of clock cycles for the trace
+ */
+static unsigned long get_clock_cycles(unsigned long hits,
+                                      unsigned long misses) {
+    return HIT_CYCLES * hits + MISS_CYCLES * misses;
+}
+
+/**
+ * @brief Generates a trace file for a kernel, validating it on the way
+ *
+ * @param[in] file_name File name where the trace should be stored
+ * @param[in] k         Index of the kernel to use
+ *
+ * @return True if the kernel succeeded, and false otherwise
+ */
+static bool generate_trace(const char *file_name, int k) {
+    char cmd[CMD_BUFSIZE];
+    snprintf(cmd, sizeof(cmd),
+             "CONTECH_TRACE=%s ./tracegen-ct -M %zu -N %zu -k %d", file_name,
+             M, N, k);
+
+    int status = system(cmd);
+    if (status < 0) {
+        printf("Failed to run tracegen-ct: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (!WIFEXITED(status)) {
+        printf("Internal error: ./tracegen-ct aborted for unknown "
+               "reason (status %x).\n",
+               status);
+        printf("Command run: %s\n", cmd);
+        return false;
+    }
+
+    if (WEXITSTATUS(status) != 0) {
+        printf("Validation error at kernel %d! Run ./tracegen-ct -M %zu "
+               "-N %zu -k %d for details.\n",
+               k, M, N, k);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Simulates a trace file on a cache
+ *
+ * @param[in]  file_name File name where the trace is stored
+ * @param[in]  cache     Geometry of the cache to simulate
+ * @param[out] stats     Statistics computed from the trace file
+ *
+ * @return True if the trace was simulated, and false otherwise
+ */
+static bool compute_stats(const char *file_name, const cache_config_t *cache,
+                          csim_stats_t *stats) {
+    cache_sim_t sim = {0};
+    bool success = false;
+
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        printf("Failed to open %s: %s\n", file_name, strerror(errno));
+        return false;
+    }
+
+    if (cacheSimInit(&sim, cache->s, cache->E, cache->b)) {
+        success = cacheSimTrace(&sim, fp);
+        if (success) {
+            memcpy(stats, &sim.stats, sizeof(*stats));
+        } else {
+            printf("Cache simulator error.  The trace could not be "
+                   "parsed\n");
+        }
+    }
+
+    cacheSimFree(&sim);
+    fclose(fp);
+    return success;
+}
+
+/**
+ * @brief Print usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] [-l] [-a] [-k <id>] -M <cols> -N <rows>\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -l          Simulate large (Haswell L1) cache\n");
+    printf("  -a          Also report the other cache (not scored)\n");
+    printf("  -k <id>     Evaluate kernel id only\n");
+    printf("  -M <cols>   Number of columns of the input matrix (max %d)\n",
+           MAXN);
+    printf("  -N <rows>   Number of rows of the input matrix (max %d)\n",
+           MAXN);
+    printf("Example: %s -M 64 -N 64\n", argv[0]);
+}
+
+/**
+ * @brief SIGALRM handler
+ */
+static void sigalrm_handler(int signum) {
+    const char *msg = "Error: Program timed out.\n";
+    ssize_t res = write(STDOUT_FILENO, msg, strlen(msg));
+    (void)res;
+    _exit(1);
+}
+
+/**
+ * @brief Main routine
+ */
+int main(int argc, char *argv[]) {
+    int c;
+    bool use_large_cache = false;
+    bool all_caches = false;
+    int selected = -1;
+
+    while ((c = getopt(argc, argv, "hlak:M:N:")) != -1) {
+        switch (c) {
+        case 'M':
+            M = (size_t)atoi(optarg);
+            break;
+        case 'N':
+            N = (size_t)atoi(optarg);
+            break;
+        case 'l':
+            use_large_cache = true;
+            break;
+        case 'a':
+            all_caches = true;
+            break;
+        case 'k':
+            selected = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (M == 0 || N == 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (M > MAXN || N > MAXN) {
+        printf("Error: M or N exceeds %d\n", MAXN);
+        usage(argv);
+        exit(1);
+    }
+
+    registerKernels();
+    if (selected >= kernel_counter) {
+        printf("Error: there is no kernel %d\n", selected);
+        exit(1);
+    }
+
+    if (signal(SIGALRM, sigalrm_handler) == SIG_ERR) {
+        fprintf(stderr, "Unable to install SIGALRM handler\n");
+        exit(1);
+    }
+
+    /* Time out and give up after a while */
+    alarm(360);
+
+    /* Use the Haswell L1 cache if requested, the original cache otherwise */
+    const cache_config_t test_cache = {TEST_LOG_SET, TEST_ASSOC,
+                                       TEST_LOG_BLOCK};
+    const cache_config_t haswell_cache = {HASWELL_L1_SET, HASWELL_L1_ASSOC,
+                                          HASWELL_L1_BLOCK};
+    cache_config_t caches[2];
+    caches[0] = use_large_cache ? haswell_cache : test_cache;
+    caches[1] = use_large_cache ? test_cache : haswell_cache;
+    int ncaches = all_caches ? 2 : 1;
+
+    csim_stats_t stats[MAX_KERNEL_FUNCS][2];
+    bool success[MAX_KERNEL_FUNCS] = {false};
+    int status = 0;
+
+    for (int k = 0; k < kernel_counter; k++) {
+        if (selected >= 0 && k != selected) {
+            continue;
+        }
+
+        char file_name[FILENAME_BUFSIZE];
+        snprintf(file_name, sizeof(file_name), "trace.k%d", k);
+
+        printf("\nKernel %d out of %d (%s: %s)\n", k, kernel_counter,
+               kernelFamilyName(kernel_list[k].family),
+               kernel_list[k].description);
+        printf("Step 1: Validating and generating memory traces\n");
+        success[k] = generate_trace(file_name, k);
+
+        for (int i = 0; success[k] && i < ncaches; i++) {
+            printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n",
+                   caches[i].s, caches[i].E, caches[i].b);
+            success[k] = compute_stats(file_name, &caches[i], &stats[k][i]);
+            if (success[k]) {
+                printf("Results for kernel %d (%s): hits:%ld, misses:%ld, "
+                       "evictions:%ld, clock_cycles:%ld\n",
+                       k, kernel_list[k].description, stats[k][i].hits,
+                       stats[k][i].misses, stats[k][i].evictions,
+                       get_clock_cycles(stats[k][i].hits,
+                                        stats[k][i].misses));
+            }
+        }
+        (void)remove(file_name);
+
+        if (!success[k]) {
+            status = 1;
+        }
+    }
+
+    /* Summarize the scored cache, kernels of a family next to each other */
+    printf("\nSummary (%zux%zu, s=%d, E=%d, b=%d)\n", M, N, caches[0].s,
+           caches[0].E, caches[0].b);
+    printf("%6s %8s %10s %14s  %s\n", "Kernel", "Family", "Misses", "Cycles",
+           "Description");
+    for (int f = 0; f < KERNEL_FAMILIES; f++) {
+        for (int k = 0; k < kernel_counter; k++) {
+            if ((int)kernel_list[k].family != f ||
+                (selected >= 0 && k != selected)) {
+                continue;
+            }
+            const char *family = kernelFamilyName(kernel_list[k].family);
+            if (!success[k]) {
+                printf("%6d %8s %10s %14s  %s\n", k, family, "-", "failed",
+                       kernel_list[k].description);
+                continue;
+            }
+            printf("%6d %8s %10lu %14lu  %s\n", k, family, stats[k][0].misses,
+                   get_clock_cycles(stats[k][0].hits, stats[k][0].misses),
+                   kernel_list[k].description);
+        }
+    }
+
+    return status;
+}
@@ -110,6 +110,64 @@ cleanup:
     return correct;
 }
 
+/**
+ * @brief Validates the correctness of one transpose function for elements
+ *        of any size, comparing them byte by byte
+ */
+bool validate_sized_func(int fn, size_t M, size_t N) {
+    size_t elem_size = func_list[fn].elem_size;
+    size_t bytes = M * N * elem_size;
+
+    /* Allocate space for matrices */
+    unsigned char *A = xaligned_alloc(64, bytes);
+    unsigned char *B = xaligned_alloc(64, bytes);
+    unsigned char *T = xaligned_alloc(64, TMPCOUNT * sizeof(double));
+    unsigned char *Acopy = xaligned_alloc(64, bytes);
+    unsigned char *Btarg = xaligned_alloc(64, bytes);
+
+    /* Clear out matrices */
+    memset(B, 0, bytes);
+    memset(T, 0, TMPCOUNT * sizeof(double));
+
+    /* Fill A with data */
+    initMatrixSized(M, N, elem_size, A);
+    memcpy(Acopy, A, bytes);
+    correctTransSized(M, N, elem_size, A, Btarg);
+
+    /* Invoke selected transpose function */
+    runTransFunction(fn, M, N, A, B, T);
+
+    bool correct = true;
+
+    /* Check correctness of transpose */
+    for (size_t k = 0; k < M * N; k++) {
+        if (memcmp(&B[k * elem_size], &Btarg[k * elem_size], elem_size) !=
+            0) {
+            fprintf(stderr,
+                    "Validation failed on function %d! Wrong %zu-byte "
+                    "element at B[%zd][%zd]\n",
+                    fn, elem_size, k / N, k % N);
+            correct = false;
+            goto cleanup;
+        }
+    }
+
+    /* Look for changes to A */
+    if (memcmp(A, Acopy, bytes) != 0) {
+        fprintf(stderr, "Validation failed on function %d! A corrupted\n",
+                fn);
+        correct = false;
+    }
+
+cleanup:
+    free(A);
+    free(B);
+    free(T);
+    free(Acopy);
+    free(Btarg);
+    return correct;
+}
+
 /**
  * @brief Evaluate the correctness of the registered transpose functions
  */
@@ -129,7 +187,9 @@ static void eval_trans(size_t M, size_t N, bool submission_only) {
 
         printf("Function %d (%s): ", i, func_list[i].description);
 
-        bool correct = validate_func(i, M, N);
+        bool correct = func_list[i].sized_ptr != NULL
+                           ? validate_sized_func(i, M, N)
+                           : validate_func(i, M, N);
         if (!correct) {
             printf("Validation error at function %d!\n", i);
             continue;
@@ -7,34 +7,79 @@
  * official submitted version as well.
  */
 
+#define _XOPEN_SOURCE 700 // mkdtemp, clock_gettime, posix_memalign
+
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h> // for LONG_MAX
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h> // for mkfifo
 #include <sys/types.h>
 #include <sys/wait.h> // for WEXITSTATUS
+#include <time.h>
 #include <unistd.h>
 
 #include "cachelab.h"
 
-#define CMD_BUFSIZE 334
+#define CMD_BUFSIZE 400
 #define FILENAME_BUFSIZE 255
 
 /* Globals set on the command line */
 static size_t M = 0;
 static size_t N = 0;
 
+/** @brief Directory holding tracegen-ct and csim-ref, relative to the cwd */
+static const char *tool_dir = ".";
+
+/** @brief Placement options passed on to tracegen-ct, see its -h */
+static const char *placement = "";
+
+/** @brief Longest placement option string accepted */
+#define MAX_PLACEMENT_LEN 64
+
+/** @brief DRAM model of -d or -D, scoring misses by their locality */
+static dram_config_t dram_config = DRAM_DEFAULT_CONFIG;
+static bool use_dram = false;
+
+/** @brief Geometry of a simulated cache */
+typedef struct {
+    unsigned int s; /* log2 of the number of sets */
+    unsigned int E; /* associativity */
+    unsigned int b; /* log2 of the block size */
+} cache_config_t;
+
+/** @brief Outcome of evaluating one function on one cache */
+typedef struct {
+    bool success;              /* whether it validated and simulated */
+    csim_stats_t stats;        /* statistics of the simulation */
+    unsigned long dram_cycles; /* cycles with the DRAM model, if enabled */
+} eval_result_t;
+
+/** @brief One evaluation of a function on a cache, possibly in a worker */
+typedef struct {
+    int funcid;                  /* index of the transpose function */
+    const cache_config_t *cache; /* cache to simulate */
+    pid_t pid;                   /* worker process, -1 if not started */
+    FILE *output;                /* captured standard output of the worker */
+    int result_fd;               /* read end of the worker's result pipe */
+    eval_result_t result;        /* outcome of the evaluation */
+} eval_job_t;
+
 /** @brief Results of testing the submitted transpose function */
 static struct {
     int funcid;
     bool correct;
     csim_stats_t stats;
-} results = {-1, false, {LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX}};
+    unsigned long dram_cycles;
+} results = {-1, false, {LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX, LONG_MAX},
+             0};
 
 /**
  * @brief Calculates the number of clock cycles for the trace
@@ -44,6 +89,17 @@ static unsigned long get_clock_cycles(unsigned long hits,
     return HIT_CYCLES * hits + MISS_CYCLES * misses;
 }
 
+/**
+ * @brief Calculates the number of clock cycles with the DRAM model
+ *
+ * Instead of a flat MISS_CYCLES, each miss and each write-back costs what
+ * the DRAM model charged for it, which depends on the row-buffer locality.
+ */
+static unsigned long get_dram_cycles(unsigned long hits,
+                                     const dram_sim_t *dram) {
+    return HIT_CYCLES * hits + dram->cycles;
+}
+
 /**
  * @brief Generates a trace file for a specific transpose function.
  *
@@ -55,8 +111,8 @@ static unsigned long get_clock_cycles(unsigned long hits,
 static bool generate_trace(const char *file_name, int i) {
     char cmd[CMD_BUFSIZE];
     snprintf(cmd, sizeof(cmd),
-             "CONTECH_TRACE=%s ./tracegen-ct -M %ld -N %ld -F %d", file_name, M,
-             N, i);
+             "CONTECH_TRACE=%s %s/tracegen-ct -M %ld -N %ld -F %d %s",
+             file_name, tool_dir, M, N, i, placement);
 
     int status = system(cmd);
     if (status < 0) {
@@ -74,8 +130,8 @@ static bool generate_trace(const char *file_name, int i) {
 
     if (WEXITSTATUS(status) != 0) {
         printf("Validation error at function %d! Run ./tracegen-ct -v -M "
-               "%zd -N %zd -F %d for details.\n",
-               i, M, N, i);
+               "%zd -N %zd -F %d %s for details.\n",
+               i, M, N, i, placement);
         printf("Exit status %d\n", WEXITSTATUS(status));
         return false;
     }
@@ -97,8 +153,9 @@ static bool generate_trace(const char *file_name, int i) {
 static bool compute_stats(const char *file_name, unsigned int s, unsigned int E,
                           unsigned int b, csim_stats_t *stats) {
     char cmd[CMD_BUFSIZE];
-    snprintf(cmd, sizeof(cmd), "./csim-ref -s %u -E %u -b %u -t %s > /dev/null",
-             s, E, b, file_name);
+    snprintf(cmd, sizeof(cmd),
+             "%s/csim-ref -s %u -E %u -b %u -t %s > /dev/null", tool_dir, s, E,
+             b, file_name);
 
     int status = system(cmd);
     if (status < 0) {
@@ -115,7 +172,7 @@ static bool compute_stats(const char *file_name, unsigned int s, unsigned int E,
     }
 
     /* Collect results from the reference simulator */
-    bool success = loadSummary(stats);
+    bool success = loadSummaryFile(CSIM_RESULTS_FILE, stats);
     if (!success) {
         printf("Cache simulator error.  Simulator generated invalid "
                "results\n");
@@ -125,15 +182,524 @@ static bool compute_stats(const char *file_name, unsigned int s, unsigned int E,
     return true;
 }
 
+/**
+ * @brief Compute statistics for a trace file with the in-process simulator
+ *
+ * Used instead of csim-ref when the misses also go to the DRAM model.
+ *
+ * @param[in]  file_name File name where the trace is stored
+ * @param[in]  s         log2 of the number of sets
+ * @param[in]  E         associativity
+ * @param[in]  b         log2 of the block size
+ * @param[out] stats     Statistics computed from the trace file
+ * @param[out] dram      DRAM model behind the cache
+ *
+ * @return True if the function succeeded, and false otherwise
+ */
+static bool compute_stats_dram(const char *file_name, unsigned int s,
+                               unsigned int E, unsigned int b,
+                               csim_stats_t *stats, dram_sim_t *dram) {
+    cache_sim_t sim = {0};
+    bool success = false;
+
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        printf("Failed to open %s: %s\n", file_name, strerror(errno));
+        return false;
+    }
+
+    if (cacheSimInit(&sim, s, E, b)) {
+        sim.dram = dram;
+        success = cacheSimTrace(&sim, fp);
+        if (success) {
+            memcpy(stats, &sim.stats, sizeof(*stats));
+        } else {
+            printf("Cache simulator error.  The trace could not be "
+                   "parsed\n");
+        }
+    }
+
+    cacheSimFree(&sim);
+    fclose(fp);
+    return success;
+}
+
+/** @brief State shared with the thread simulating an online trace */
+typedef struct {
+    FILE *fp;         /* read end of the trace pipe */
+    cache_sim_t *sim; /* simulator fed by the trace */
+    bool success;     /* whether the trace was parsed completely */
+} online_sim_t;
+
+/**
+ * @brief Simulates the trace arriving on a pipe until the writer closes it
+ */
+static void *online_sim_thread(void *arg) {
+    online_sim_t *online = arg;
+    online->success = cacheSimTrace(online->sim, online->fp);
+
+    /* Keep draining so that tracegen-ct never blocks on a full pipe */
+    char buf[BUFSIZ];
+    while (fread(buf, 1, sizeof(buf), online->fp) > 0) {
+    }
+    return NULL;
+}
+
+/**
+ * @brief Validates a transpose function and simulates its trace online.
+ *
+ * Instead of writing a trace file and re-reading it with csim-ref,
+ * tracegen-ct writes its trace into a named pipe which is consumed by an
+ * in-process simulator while the trace is being generated.
+ *
+ * @param[in]  i      Index of the transpose function to use
+ * @param[in]  s      log2 of the number of sets
+ * @param[in]  E      associativity
+ * @param[in]  b      log2 of the block size
+ * @param[out] stats  Statistics computed from the trace
+ * @param[out] dram   DRAM model behind the cache, or NULL
+ *
+ * @return True if the function succeeded, and false otherwise
+ */
+static bool simulate_online(int i, unsigned int s, unsigned int E,
+                            unsigned int b, csim_stats_t *stats,
+                            dram_sim_t *dram) {
+    char dir[] = "/tmp/cachelab.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        printf("Failed to create temporary directory: %s\n", strerror(errno));
+        return false;
+    }
+
+    char fifo_name[FILENAME_BUFSIZE];
+    snprintf(fifo_name, sizeof(fifo_name), "%s/trace.f%d", dir, i);
+    if (mkfifo(fifo_name, 0600) < 0) {
+        printf("Failed to create trace pipe: %s\n", strerror(errno));
+        (void)rmdir(dir);
+        return false;
+    }
+
+    /*
+     * Hold a write end open ourselves, so the simulator only sees the end of
+     * the trace once tracegen-ct has exited, even if it never opens the pipe.
+     */
+    bool success = false;
+    cache_sim_t sim = {0};
+    online_sim_t online = {NULL, &sim, false};
+    int write_fd = -1;
+    int read_fd = open(fifo_name, O_RDONLY | O_NONBLOCK);
+    if (read_fd >= 0) {
+        write_fd = open(fifo_name, O_WRONLY);
+    }
+    if (read_fd < 0 || write_fd < 0) {
+        printf("Failed to open trace pipe: %s\n", strerror(errno));
+        goto cleanup;
+    }
+    (void)fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) & ~O_NONBLOCK);
+
+    if (!cacheSimInit(&sim, s, E, b)) {
+        goto cleanup;
+    }
+    sim.dram = dram;
+
+    pthread_t thread;
+    online.fp = fdopen(read_fd, "r");
+    if (online.fp == NULL ||
+        pthread_create(&thread, NULL, online_sim_thread, &online) != 0) {
+        printf("Failed to start online simulator\n");
+        goto cleanup;
+    }
+
+    bool generated = generate_trace(fifo_name, i);
+
+    close(write_fd);
+    write_fd = -1;
+    pthread_join(thread, NULL);
+
+    if (generated && !online.success) {
+        printf("Cache simulator error.  The online simulator could not "
+               "parse the trace\n");
+    }
+    success = generated && online.success;
+    if (success) {
+        memcpy(stats, &sim.stats, sizeof(*stats));
+    }
+
+cleanup:
+    if (online.fp != NULL) {
+        fclose(online.fp);
+    } else if (read_fd >= 0) {
+        close(read_fd);
+    }
+    if (write_fd >= 0) {
+        close(write_fd);
+    }
+    cacheSimFree(&sim);
+    (void)unlink(fifo_name);
+    (void)rmdir(dir);
+    return success;
+}
+
+/**
+ * @brief Evaluate the performance of one transpose function on one cache
+ *
+ * @param[in]  i      Index of the transpose function to use
+ * @param[in]  cache  Geometry of the cache to simulate
+ * @param[in]  online Whether to simulate without writing a trace file
+ * @param[out] stats  Statistics computed from the trace
+ * @param[out] dram_cycles Cycles with the DRAM model, if enabled
+ *
+ * @return True if the function succeeded, and false otherwise
+ */
+static bool eval_func(int i, const cache_config_t *cache, bool online,
+                      csim_stats_t *stats, unsigned long *dram_cycles) {
+    unsigned int s = cache->s;
+    unsigned int E = cache->E;
+    unsigned int b = cache->b;
+    dram_sim_t dram;
+    bool success = false;
+
+    if (use_dram && !dramSimInit(&dram, &dram_config)) {
+        return false;
+    }
+
+    /* Run and generate a trace file */
+    char file_name[FILENAME_BUFSIZE];
+    sprintf(file_name, "trace.f%d", i);
+
+    printf("\nFunction %d out of %d (%s)\n", i, func_counter,
+           func_list[i].description);
+
+    if (online) {
+        /* Validate and simulate without writing a trace file */
+        printf("Step 1: Validating and simulating memory traces online "
+               "(s=%d, E=%d, b=%d)\n",
+               s, E, b);
+        if (!simulate_online(i, s, E, b, stats, use_dram ? &dram : NULL)) {
+            goto cleanup;
+        }
+    } else {
+        printf("Step 1: Validating and generating memory traces\n");
+
+        if (!generate_trace(file_name, i)) {
+            goto cleanup;
+        }
+
+        /* Run the reference simulator, or ours when it feeds the DRAM */
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E,
+               b);
+        if (use_dram) {
+            if (!compute_stats_dram(file_name, s, E, b, stats, &dram)) {
+                goto cleanup;
+            }
+        } else if (!compute_stats(file_name, s, E, b, stats)) {
+            goto cleanup;
+        }
+
+        (void)remove(CSIM_RESULTS_FILE);
+    }
+
+    /* Mark this function as correct */
+    printf("Results for func %d (%s): hits:%ld, misses:%ld, evictions:%ld, "
+           "clock_cycles:%ld\n",
+           i, func_list[i].description, stats->hits, stats->misses,
+           stats->evictions, get_clock_cycles(stats->hits, stats->misses));
+    if (use_dram) {
+        *dram_cycles = get_dram_cycles(stats->hits, &dram);
+        printf("DRAM for func %d: reads:%lu, writes:%lu, row_hits:%lu, "
+               "row_empty:%lu, row_conflicts:%lu, dram_cycles:%lu\n",
+               i, dram.reads, dram.writes, dram.row_hits, dram.row_empty,
+               dram.row_conflicts, *dram_cycles);
+    }
+    success = true;
+
+cleanup:
+    if (use_dram) {
+        dramSimFree(&dram);
+    }
+    return success;
+}
+
+/** @brief Write end of the result pipe, in a worker process */
+static int worker_result_fd = -1;
+
+/**
+ * @brief SIGSEGV handler of a worker process
+ *
+ * Only the job of the worker failed, and the parent still prints the
+ * results line once all jobs are done, so the worker reports the failure
+ * through its pipe instead of printing a results line of its own.
+ */
+static void worker_sigsegv_handler(int signum) {
+    const char *msg = "Error: Segmentation Fault.\n";
+    eval_result_t failed = {.success = false};
+    ssize_t res = write(STDOUT_FILENO, msg, strlen(msg));
+    res = write(worker_result_fd, &failed, sizeof(failed));
+    (void)res;
+    _exit(1);
+}
+
+/**
+ * @brief Start a worker process that evaluates one job
+ *
+ * The worker runs in a private directory, so that its trace file and the
+ * .csim_results file written by csim-ref do not collide with other workers.
+ * Its output is captured and its result sent back through a pipe.
+ */
+static bool start_worker(eval_job_t *job, bool online) {
+    int fds[2];
+    job->output = tmpfile();
+    if (job->output == NULL || pipe(fds) < 0) {
+        printf("Failed to start worker: %s\n", strerror(errno));
+        return false;
+    }
+
+    fflush(stdout);
+    job->pid = fork();
+    if (job->pid < 0) {
+        printf("Failed to start worker: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (job->pid == 0) {
+        char dir[] = ".test-trans.XXXXXX";
+        close(fds[0]);
+        dup2(fileno(job->output), STDOUT_FILENO);
+        worker_result_fd = fds[1];
+        signal(SIGSEGV, worker_sigsegv_handler);
+
+        if (mkdtemp(dir) == NULL || chdir(dir) < 0) {
+            printf("Failed to create worker directory: %s\n",
+                   strerror(errno));
+        } else {
+            tool_dir = "..";
+            job->result.success =
+                eval_func(job->funcid, job->cache, online, &job->result.stats,
+                          &job->result.dram_cycles);
+
+            char file_name[FILENAME_BUFSIZE];
+            snprintf(file_name, sizeof(file_name), "trace.f%d", job->funcid);
+            (void)remove(file_name);
+            (void)remove(CSIM_RESULTS_FILE);
+            if (chdir("..") == 0) {
+                (void)rmdir(dir);
+            }
+        }
+
+        fflush(stdout);
+        ssize_t res = write(fds[1], &job->result, sizeof(job->result));
+        (void)res;
+        _exit(0);
+    }
+
+    close(fds[1]);
+    job->result_fd = fds[0];
+    return true;
+}
+
+/**
+ * @brief Run jobs in up to max_workers concurrent worker processes
+ *
+ * The output and results of the workers are collected in job order, so the
+ * report looks the same as a serial run.
+ */
+static void eval_parallel(eval_job_t *jobs, int njobs, int max_workers,
+                          bool online) {
+    int running = 0;
+    int next = 0;
+
+    while (next < njobs || running > 0) {
+        if (next < njobs && running < max_workers) {
+            if (start_worker(&jobs[next], online)) {
+                running++;
+            }
+            next++;
+            continue;
+        }
+        if (wait(NULL) < 0) {
+            break;
+        }
+        running--;
+    }
+
+    for (int j = 0; j < njobs; j++) {
+        eval_job_t *job = &jobs[j];
+        if (job->output != NULL) {
+            char buf[BUFSIZ];
+            size_t n;
+            fflush(stdout);
+            rewind(job->output);
+            while ((n = fread(buf, 1, sizeof(buf), job->output)) > 0) {
+                fwrite(buf, 1, n, stdout);
+            }
+            fclose(job->output);
+        }
+        if (job->pid > 0) {
+            eval_result_t result;
+            if (read(job->result_fd, &result, sizeof(result)) ==
+                (ssize_t)sizeof(result)) {
+                job->result = result;
+            }
+            close(job->result_fd);
+        }
+    }
+}
+
+/**
+ * @brief Returns the current time in seconds
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Times a transpose function running natively
+ *
+ * The matrices are aligned on cache blocks, as in tracegen-ct, and the
+ * function runs once untimed to warm up the caches. Only A is filled
+ * beforehand: the pages of B are first touched by the function itself, so a
+ * multithreaded function places them next to the threads writing them.
+ *
+ * @param[in]  i        Index of the transpose function to use
+ * @param[in]  runs     Number of timed runs, the fastest one counts
+ * @param[out] seconds  Wall time of the fastest run
+ *
+ * @return True if the function succeeded, and false otherwise
+ */
+static bool time_native(int i, int runs, double *seconds) {
+    size_t bytes = M * N * func_list[i].elem_size;
+    void *A = NULL;
+    void *B = NULL;
+    void *tmp = NULL;
+    bool success = false;
+
+    if (posix_memalign(&A, 64, bytes) != 0 ||
+        posix_memalign(&B, 64, bytes) != 0 ||
+        posix_memalign(&tmp, 64, TMPCOUNT * sizeof(double)) != 0) {
+        printf("Failed to allocate matrices for the native benchmark\n");
+        goto cleanup;
+    }
+
+    if (func_list[i].sized_ptr != NULL) {
+        initMatrixSized(M, N, func_list[i].elem_size, A);
+    } else {
+        double *a = A;
+        for (size_t k = 0; k < M * N; k++) {
+            a[k] = (double)k;
+        }
+    }
+    runTransFunction(i, M, N, A, B, tmp);
+
+    *seconds = 0;
+    for (int run = 0; run < runs; run++) {
+        double start = now();
+        runTransFunction(i, M, N, A, B, tmp);
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < *seconds) {
+            *seconds = elapsed;
+        }
+    }
+    success = true;
+
+cleanup:
+    free(A);
+    free(B);
+    free(tmp);
+    return success;
+}
+
+/**
+ * @brief Times every function that passed evaluation, natively
+ *
+ * Runs after all the evaluations, so that no worker competes for the CPU,
+ * and reports the throughput next to the simulated cycles on the scored
+ * cache. Reading A and writing B counts as 2 * M * N elements moved.
+ *
+ * With scaling, every function is timed with 1, 2, 4, ... threads up to the
+ * number of online processors, and the speedup over one thread is reported.
+ * Otherwise the functions start as many threads as transThreads() says.
+ *
+ * @param[in] jobs     The evaluations, as run by eval_perf()
+ * @param[in] njobs    Number of evaluations
+ * @param[in] cache    The scored cache
+ * @param[in] runs     Number of timed runs per function
+ * @param[in] scaling  Whether to time every function at each thread count
+ */
+static void bench_native(const eval_job_t *jobs, int njobs,
+                         const cache_config_t *cache, int runs, bool scaling) {
+    double base[MAX_TRANS_FUNCS * 2];
+    long max_threads = scaling ? sysconf(_SC_NPROCESSORS_ONLN) : 0;
+
+    printf("\nNative benchmark (%zux%zu, fastest of %d runs)\n", M, N, runs);
+    printf("%4s %7s %12s %10s %8s %14s  %s\n", "Func", "Threads", "Seconds",
+           "GB/s", "Speedup", "Sim. cycles", "Description");
+
+    for (long threads = 1;; threads *= 2) {
+        if (scaling) {
+            if (threads > max_threads) {
+                threads = max_threads;
+            }
+            char value[32];
+            snprintf(value, sizeof(value), "%ld", threads);
+            setenv(TRANS_THREADS_ENV, value, 1);
+        }
+
+        for (int j = 0; j < njobs; j++) {
+            const eval_job_t *job = &jobs[j];
+            double seconds;
+
+            if (job->cache != cache || !job->result.success) {
+                continue;
+            }
+            if (!time_native(job->funcid, runs, &seconds)) {
+                return;
+            }
+            if (threads == 1) {
+                base[j] = seconds;
+            }
+            double bytes = 2.0 * (double)M * (double)N *
+                           (double)func_list[job->funcid].elem_size;
+            printf("%4d %7u %12.6f %10.2f %8.2f %14lu  %s\n", job->funcid,
+                   transThreads(), seconds,
+                   seconds > 0 ? bytes / seconds / 1e9 : 0.0,
+                   seconds > 0 ? base[j] / seconds : 0.0,
+                   get_clock_cycles(job->result.stats.hits,
+                                    job->result.stats.misses),
+                   func_list[job->funcid].description);
+        }
+
+        if (!scaling || threads >= max_threads) {
+            break;
+        }
+    }
+}
+
 /**
  * @brief Evaluate the performance of the registered transpose functions
+ *
+ * Each function is evaluated on every cache in caches. The submission is
+ * scored on the first one.
+ *
+ * @param[in] caches          Caches to simulate
+ * @param[in] ncaches         Number of caches
+ * @param[in] submission_only Whether to evaluate the submission only
+ * @param[in] online          Whether to simulate without writing trace files
+ * @param[in] max_workers     Number of functions to evaluate concurrently
+ * @param[in] bench_runs      Timed native runs per function, 0 for none
+ * @param[in] scaling         Whether to time at every thread count
  */
-static void eval_perf(unsigned int s, unsigned int E, unsigned int b,
-                      bool submission_only) {
+static void eval_perf(const cache_config_t *caches, int ncaches,
+                      bool submission_only, bool online, int max_workers,
+                      int bench_runs, bool scaling) {
+    eval_job_t jobs[MAX_TRANS_FUNCS * 2];
+    int njobs = 0;
 
     registerFunctions();
 
-    /* Evaluate the performance of each registered transpose function */
+    /* Collect the evaluations, in the order the report lists them */
     for (int i = 0; i < func_counter; i++) {
         /* Remember if this function is the submission */
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0) {
@@ -145,51 +711,66 @@ static void eval_perf(unsigned int s, unsigned int E, unsigned int b,
             continue;
         }
 
-        /* Run and generate a trace file */
-        char file_name[FILENAME_BUFSIZE];
-        sprintf(file_name, "trace.f%d", i);
-
-        printf("\nFunction %d out of %d (%s)\n", i, func_counter,
-               func_list[i].description);
-        printf("Step 1: Validating and generating memory traces\n");
-
-        if (!generate_trace(file_name, i)) {
-            continue;
+        for (int c = 0; c < ncaches; c++) {
+            eval_job_t *job = &jobs[njobs++];
+            memset(job, 0, sizeof(*job));
+            job->funcid = i;
+            job->cache = &caches[c];
+            job->pid = -1;
+            job->result_fd = -1;
         }
+    }
 
-        /* Run the reference simulator */
-        csim_stats_t stats;
-
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        if (!compute_stats(file_name, s, E, b, &stats)) {
-            continue;
+    if (max_workers > 1) {
+        eval_parallel(jobs, njobs, max_workers, online);
+    } else {
+        for (int j = 0; j < njobs; j++) {
+            jobs[j].result.success =
+                eval_func(jobs[j].funcid, jobs[j].cache, online,
+                          &jobs[j].result.stats, &jobs[j].result.dram_cycles);
         }
+    }
 
-        (void)remove(".csim_results");
-
-        /* Mark this function as correct */
-        printf("Results for func %d (%s): hits:%ld, misses:%ld, evictions:%ld, "
-               "clock_cycles:%ld\n",
-               i, func_list[i].description, stats.hits, stats.misses,
-               stats.evictions, get_clock_cycles(stats.hits, stats.misses));
-
-        /* If it is transpose_submit(), record number of misses */
-        if (results.funcid == i) {
-            memcpy(&results.stats, &stats, sizeof(results.stats));
+    /* If it is transpose_submit(), record number of misses */
+    for (int j = 0; j < njobs; j++) {
+        if (jobs[j].funcid == results.funcid && jobs[j].cache == &caches[0] &&
+            jobs[j].result.success) {
+            memcpy(&results.stats, &jobs[j].result.stats,
+                   sizeof(results.stats));
+            results.dram_cycles = jobs[j].result.dram_cycles;
             results.correct = true;
         }
     }
+
+    if (bench_runs > 0) {
+        bench_native(jobs, njobs, &caches[0], bench_runs, scaling);
+    }
 }
 
 /**
  * @brief Print usage info
  */
 static void usage(char *argv[]) {
-    printf("Usage: %s [-h] [-s] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-h] [-s] [-l] [-a] [-o] [-d | -D <dram>] [-j <n>] "
+           "[-t <n>] [-b <runs> [-S]] -M <rows> -N <cols>\n",
+           argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -s          Check official submission only.\n");
     printf("  -l          Simulate large (Haswell L1) cache\n");
+    printf("  -a          Also report the other cache (not scored)\n");
+    printf("  -o          Simulate online, without writing trace files\n");
+    printf("  -d          Also score misses with the DRAM model\n");
+    printf("  -D <dram>   Same with DRAM settings, e.g. "
+           "\"banks=16,row=4096,cas=30\"\n");
+    printf("  -j <n>      Run n evaluations concurrently (0: one per core)\n");
+    printf("  -t <n>      Let multithreaded functions start n threads when "
+           "run natively\n");
+    printf("  -b <runs>   Also time each function natively, fastest of runs\n");
+    printf("  -S          Time natively with 1, 2, 4, ... threads up to the "
+           "core count\n");
+    printf("  -p <opts>   Place the matrices with tracegen-ct options, e.g. "
+           "\"-A 64\"\n");
     printf("  -M <rows>   Number of destination matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of destination matrix columns (max %d)\n",
            MAXN);
@@ -227,8 +808,13 @@ int main(int argc, char *argv[]) {
 
     bool submission_only = false;
     bool use_large_cache = false;
+    bool all_caches = false;
+    bool online = false;
+    long max_workers = 1;
+    int bench_runs = 0;
+    bool scaling = false;
 
-    while ((c = getopt(argc, argv, "hcslM:N:")) != -1) {
+    while ((c = getopt(argc, argv, "hcslaodD:j:t:b:Sp:M:N:")) != -1) {
         switch (c) {
         case 'M':
             M = (size_t)atoi(optarg);
@@ -242,6 +828,59 @@ int main(int argc, char *argv[]) {
         case 'l':
             use_large_cache = true;
             break;
+        case 'a':
+            all_caches = true;
+            break;
+        case 'o':
+            online = true;
+            break;
+        case 'D':
+            if (!dramParseConfig(&dram_config, optarg)) {
+                printf("Error: invalid DRAM settings '%s'\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            use_dram = true;
+            break;
+        case 'd':
+            use_dram = true;
+            break;
+        case 'j':
+            max_workers = atoi(optarg);
+            if (max_workers == 0) {
+                max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (max_workers < 1) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 't':
+            if (atoi(optarg) < 1) {
+                usage(argv);
+                exit(1);
+            }
+            setenv(TRANS_THREADS_ENV, optarg, 1);
+            break;
+        case 'S':
+            scaling = true;
+            break;
+        case 'p':
+            /* Only the placement options, which take numbers, may pass */
+            if (strlen(optarg) > MAX_PLACEMENT_LEN ||
+                strspn(optarg, "-ATBG 0123456789") != strlen(optarg)) {
+                usage(argv);
+                exit(1);
+            }
+            placement = optarg;
+            break;
+        case 'b':
+            bench_runs = atoi(optarg);
+            if (bench_runs < 1) {
+                usage(argv);
+                exit(1);
+            }
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -277,15 +916,18 @@ int main(int argc, char *argv[]) {
     /* Time out and give up after a while */
     alarm(360);
 
+    /* Use the Haswell L1 cache if requested, the original cache otherwise */
+    const cache_config_t test_cache = {TEST_LOG_SET, TEST_ASSOC,
+                                       TEST_LOG_BLOCK};
+    const cache_config_t haswell_cache = {HASWELL_L1_SET, HASWELL_L1_ASSOC,
+                                          HASWELL_L1_BLOCK};
+    cache_config_t caches[2];
+    caches[0] = use_large_cache ? haswell_cache : test_cache;
+    caches[1] = use_large_cache ? test_cache : haswell_cache;
+
     /* Check the performance of the student's transpose function */
-    if (use_large_cache) {
-        /* Use Haswell L1 cache */
-        eval_perf(HASWELL_L1_SET, HASWELL_L1_ASSOC, HASWELL_L1_BLOCK,
-                  submission_only);
-    } else {
-        /* Use original cache otherwise */
-        eval_perf(TEST_LOG_SET, TEST_ASSOC, TEST_LOG_BLOCK, submission_only);
-    }
+    eval_perf(caches, all_caches ? 2 : 1, submission_only, online,
+              (int)max_workers, bench_runs, scaling);
 
     /* Emit the results for this particular test */
     if (results.funcid == -1) {
@@ -300,6 +942,9 @@ int main(int argc, char *argv[]) {
                "cycles=%ld\n",
                results.funcid, results.correct,
                get_clock_cycles(results.stats.hits, results.stats.misses));
+        if (use_dram) {
+            printf("DRAM model score: dram_cycles=%lu\n", results.dram_cycles);
+        }
         printf("\nTEST_TRANS_RESULTS=%d:%ld\n", results.correct,
                get_clock_cycles(results.stats.hits, results.stats.misses));
         status = !results.correct;
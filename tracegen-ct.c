@@ -6,16 +6,24 @@
  * the registered transpose functions; however, if multiple functions
  * are invoked during a single execution, the trace will contain
  * all of the accesses together.
+ *
+ * With -k, it traces one of the kernels of kernels.c instead, and with -C,
+ * trans_tuned() of trans.c with the given tile configuration.
  */
 
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MAP_HUGETLB, madvise
+
 #include "cachelab.h"
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "cachelab.h"
@@ -24,22 +32,112 @@
 extern void __roi_begin(void);
 extern void __roi_end(void);
 
-/* Need to make sure A and B start on cache block boundaries */
-static double bigA[MAXN][MAXN] __attribute__((aligned(64)));
-static double bigT[TMPCOUNT] __attribute__((aligned(64)));
-static double bigB[MAXN][MAXN] __attribute__((aligned(64)));
-static double bigAcopy[MAXN][MAXN];
-static double bigBtarg[MAXN][MAXN];
+/** @brief Bytes of the tmp array */
+#define TMP_BYTES (TMPCOUNT * sizeof(double))
+
+/** @brief Largest offset or gap accepted on the command line */
+#define MAX_PLACEMENT ((size_t)1 << 20)
+
+/** @brief Rows past the end of B that validate() checks are left alone */
+#define GUARD_ROWS 10
+
+/** @brief Size of a huge page, to which mappings are rounded */
+#define HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+/*
+ * A, tmp and B are carved out of one arena, so that their placement can be
+ * changed from the command line. By default they follow each other in
+ * slot_bytes slots, so all three start on cache block boundaries. The
+ * arena and the reference matrices are mapped at the size the problem
+ * needs, and start out zeroed.
+ */
+static unsigned char *arena;
+static size_t slot_bytes; /* bytes of a matrix with its guard rows */
+static double *bigA;
+static double *bigT;
+static double *bigB;
+static void *bigAcopy;
+static void *bigBtarg;
 static size_t M;
 static size_t N;
 
+/* Placement of the matrices, set on the command line */
+static size_t offset_a = 0; /* bytes added to the address of A */
+static size_t offset_t = 0; /* bytes added to the address of tmp */
+static size_t offset_b = 0; /* bytes added to the address of B */
+static long gap = -1;       /* bytes between matrices, or -1 for slots */
+static bool huge = false;   /* whether to map explicit huge pages */
+
+/** @brief Bytes the validators check at once before looking closer */
+#define CHUNK_BYTES 64
+
+/**
+ * @brief Finds the first of n doubles that is not zero, or returns n
+ *
+ * Whole chunks are OR-ed together with the sign bits shifted out, so -0.0
+ * counts as zero like it does for !=, and the loop vectorizes.
+ */
+static size_t first_nonzero(const double *x, size_t n) {
+    const size_t per_chunk = CHUNK_BYTES / sizeof(double);
+    size_t k, c;
+    for (k = 0; k + per_chunk <= n; k += per_chunk) {
+        uint64_t any = 0;
+        for (c = 0; c < per_chunk; c++) {
+            uint64_t word;
+            memcpy(&word, &x[k + c], sizeof(word));
+            any |= word << 1;
+        }
+        if (any != 0) {
+            break;
+        }
+    }
+    for (; k < n; k++) {
+        if (x[k] != 0) {
+            return k;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Finds the first of n bytes that is not zero, or returns n
+ */
+static size_t first_nonzero_byte(const unsigned char *x, size_t n) {
+    size_t k, c;
+    for (k = 0; k + CHUNK_BYTES <= n; k += CHUNK_BYTES) {
+        uint64_t any = 0;
+        for (c = 0; c < CHUNK_BYTES; c += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, &x[k + c], sizeof(word));
+            any |= word;
+        }
+        if (any != 0) {
+            break;
+        }
+    }
+    for (; k < n; k++) {
+        if (x[k] != 0) {
+            return k;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Validates a transpose function
+ *
+ * Whole rows are compared with memcmp(), and only a row that differs is
+ * scanned element by element for the error message. Every element holds
+ * finite, nonzero data, so comparing bits is the same as comparing values.
+ */
 bool validate(int fn, double A[N][M], double Acopy[N][M], double B[M][N],
               double Btarg[M][N]) {
     size_t i, j;
-    size_t xM = M + 10;
-    if (xM > MAXN)
-        xM = MAXN;
+    size_t xM = M + GUARD_ROWS;
     for (i = 0; i < M; i++) {
+        if (memcmp(B[i], Btarg[i], N * sizeof(double)) == 0) {
+            continue;
+        }
         for (j = 0; j < N; j++) {
             if (B[i][j] != Btarg[i][j]) {
                 fprintf(stderr,
@@ -53,6 +151,9 @@ bool validate(int fn, double A[N][M], double Acopy[N][M], double B[M][N],
 
     /* Look for changes to A */
     for (j = 0; j < N; j++) {
+        if (memcmp(A[j], Acopy[j], M * sizeof(double)) == 0) {
+            continue;
+        }
         for (i = 0; i < M; i++) {
             if (A[j][i] != Acopy[j][i]) {
                 fprintf(
@@ -65,24 +166,307 @@ bool validate(int fn, double A[N][M], double Acopy[N][M], double B[M][N],
     }
 
     /* Look for out of bounds writes to B, scanning a few more rows */
-    for (i = M; i < xM; i++)
+    for (i = M; i < xM; i++) {
+        j = first_nonzero(B[i], N);
+        if (j < N) {
+            fprintf(stderr,
+                    "Validation failed on function %d! Out-of-bounds write "
+                    "to B[%zd][%zd]\n",
+                    fn, i, j);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Validates a transpose function for elements of any size
+ *
+ * Works like validate(), comparing elements byte by byte.
+ */
+bool validate_sized(int fn, size_t elem_size) {
+    const unsigned char *A = (const unsigned char *)bigA;
+    const unsigned char *Acopy = (const unsigned char *)bigAcopy;
+    const unsigned char *B = (const unsigned char *)bigB;
+    const unsigned char *Btarg = (const unsigned char *)bigBtarg;
+    size_t row_bytes = N * elem_size;
+    size_t i, j;
+
+    for (i = 0; i < M; i++) {
+        const unsigned char *row = &B[i * row_bytes];
+        const unsigned char *targ = &Btarg[i * row_bytes];
+        if (memcmp(row, targ, row_bytes) == 0) {
+            continue;
+        }
         for (j = 0; j < N; j++) {
-            if (B[i][j] != 0) {
+            if (memcmp(&row[j * elem_size], &targ[j * elem_size],
+                       elem_size) != 0) {
                 fprintf(stderr,
-                        "Validation failed on function %d! Out-of-bounds write "
-                        "to B[%zd][%zd]\n",
-                        fn, i, j);
+                        "Validation failed on function %d! Wrong %zu-byte "
+                        "element at B[%zd][%zd]\n",
+                        fn, elem_size, i, j);
                 return false;
             }
         }
+    }
+
+    /* Look for changes to A */
+    if (memcmp(A, Acopy, M * N * elem_size) != 0) {
+        fprintf(stderr, "Validation failed on function %d! A corrupted\n",
+                fn);
+        return false;
+    }
+
+    /* Look for out of bounds writes to B, scanning a few more rows */
+    for (i = M; i < M + GUARD_ROWS; i++) {
+        j = first_nonzero_byte(&B[i * row_bytes], row_bytes);
+        if (j < row_bytes) {
+            fprintf(stderr,
+                    "Validation failed on function %d! Out-of-bounds write "
+                    "to B[%zd][%zd]\n",
+                    fn, i, j / elem_size);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Places A, tmp and B in the arena for elements of elem_size bytes
+ *
+ * Without a gap, each matrix starts where its slot_bytes slot does. With
+ * a gap, tmp starts gap bytes after the last element of A, and B gap bytes
+ * after the end of tmp. The offsets of each matrix are added on top.
+ */
+static void place(size_t elem_size) {
+    size_t a_bytes = gap < 0 ? slot_bytes : M * N * elem_size;
+    size_t between = gap < 0 ? 0 : (size_t)gap;
+
+    unsigned char *a = arena + offset_a;
+    unsigned char *t = a + a_bytes + between + offset_t;
+    unsigned char *b = t + TMP_BYTES + between + offset_b;
+    bigA = (double *)a;
+    bigT = (double *)t;
+    bigB = (double *)b;
+}
+
+/**
+ * @brief Maps zeroed memory for bytes, rounded up to a huge page
+ *
+ * With -H the mapping uses explicit huge pages when some are reserved, and
+ * falls back to normal pages otherwise. Normal mappings are offered to
+ * transparent huge pages. Either way, the memory is page aligned.
+ */
+static void *map_zeroed(size_t bytes) {
+    void *p = MAP_FAILED;
+    bytes = (bytes > 0 ? bytes : 1) + HUGE_PAGE_BYTES - 1;
+    bytes &= ~(HUGE_PAGE_BYTES - 1);
+#ifdef MAP_HUGETLB
+    if (huge) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "Error: unable to map %zu bytes: %s\n", bytes,
+                    strerror(errno));
+            exit(1);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+}
+
+/**
+ * @brief Maps the arena and reference matrices for the registered functions
+ *
+ * Each matrix gets room for the largest element of any function, plus the
+ * guard rows of B. Slots are whole huge pages, so the default layout maps
+ * to cache sets exactly as adjacent MAXN x MAXN arrays would.
+ */
+static void allocate(void) {
+    size_t elem_max = sizeof(double);
+    int i;
+    for (i = 0; i < func_counter; i++) {
+        if (func_list[i].elem_size > elem_max) {
+            elem_max = func_list[i].elem_size;
+        }
+    }
+
+    slot_bytes = (M + GUARD_ROWS) * N * elem_max;
+    slot_bytes = (slot_bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    arena = map_zeroed(2 * slot_bytes + TMP_BYTES + 5 * MAX_PLACEMENT);
+    bigAcopy = map_zeroed(M * N * elem_max);
+    bigBtarg = map_zeroed(M * N * elem_max);
+}
+
+/**
+ * @brief Fills A, its copy, and the expected B for function fn
+ *
+ * B is cleared along with the rows validate() scans past its end, since a
+ * function run before may have used another element size.
+ */
+static void prepare(int fn) {
+    size_t elem_size = func_list[fn].elem_size;
+    size_t clear = (M + GUARD_ROWS) * N * (elem_size > 8 ? elem_size : 8);
+
+    place(elem_size);
+    memset(bigB, 0, clear);
+    if (func_list[fn].sized_ptr == NULL) {
+        /* Fill A with data */
+        initMatrix(M, N, (void *)bigA, (void *)bigB);
+        /* Make copy of A */
+        copyMatrix(M, N, bigAcopy, (void *)bigA);
+        /* Generate target version */
+        correctTrans(M, N, (void *)bigA, bigBtarg);
+    } else {
+        initMatrixSized(M, N, elem_size, bigA);
+        memcpy(bigAcopy, bigA, M * N * elem_size);
+        correctTransSized(M, N, elem_size, bigA, bigBtarg);
+    }
+}
+
+/**
+ * @brief Runs and validates function fn, tracing its accesses
+ */
+static bool trace_func(int fn) {
+    prepare(fn);
+    memset(bigT, 0, TMP_BYTES);
+    __roi_begin();
+    runTransFunction(fn, M, N, bigA, bigB, bigT);
+    __roi_end();
+    if (func_list[fn].sized_ptr != NULL) {
+        return validate_sized(fn, func_list[fn].elem_size);
+    }
+    return validate(fn, (void *)bigA, bigAcopy, (void *)bigB, bigBtarg);
+}
+
+/**
+ * @brief Runs and validates trans_tuned() with one configuration, tracing
+ *        its accesses
+ *
+ * The matrices are those of the submitted function, number 0.
+ */
+static bool trace_tuned(const tune_config_t *config) {
+    prepare(0);
+    memset(bigT, 0, TMP_BYTES);
+    __roi_begin();
+    tuned_func(M, N, (void *)bigA, (void *)bigB, bigT, config->rows,
+               config->cols, config->order, config->diag);
+    __roi_end();
+    return validate(0, (void *)bigA, bigAcopy, (void *)bigB, bigBtarg);
+}
+
+/**
+ * @brief Parses a tile configuration of the form rows,cols,order,diag
+ *
+ * order and diag are the values of tune_order_t and tune_diag_t.
+ *
+ * @return True on success, false otherwise
+ */
+static bool parse_tune_config(const char *spec, tune_config_t *config) {
+    int order;
+    int diag;
+    char extra;
+    if (sscanf(spec, "%zu,%zu,%d,%d%c", &config->rows, &config->cols, &order,
+               &diag, &extra) != 4) {
+        return false;
+    }
+    if (config->rows == 0 || config->cols == 0 || config->cols > TMPCOUNT ||
+        order < TUNE_ORDER_ROWS || order > TUNE_ORDER_COLS ||
+        diag < TUNE_DIAG_NONE || diag > TUNE_DIAG_BUFFER) {
+        return false;
+    }
+    config->order = (tune_order_t)order;
+    config->diag = (tune_diag_t)diag;
+    return true;
+}
+
+/**
+ * @brief Runs and validates kernel k, tracing its accesses
+ *
+ * The operands are mapped on their own, with GUARD_ROWS rows of the longer
+ * side of in after out that the kernel must leave alone. The placement
+ * options only apply to transpose functions.
+ */
+static bool trace_kernel(int k) {
+    kernel_family_t family = kernel_list[k].family;
+    kernel_shape_t shape = kernelShape(family, M, N);
+    size_t in_bytes = shape.in_elems * sizeof(double);
+    size_t out_elems = shape.out_elems + GUARD_ROWS * (M > N ? M : N);
+    size_t i;
+
+    double *in = map_zeroed(in_bytes);
+    double *in_copy = map_zeroed(in_bytes);
+    void *aux = map_zeroed(shape.aux_bytes);
+    void *aux_copy = map_zeroed(shape.aux_bytes);
+    double *out = map_zeroed(out_elems * sizeof(double));
+    double *out_targ = map_zeroed(shape.out_elems * sizeof(double));
+
+    kernelSetup(family, M, N, in, aux);
+    memcpy(in_copy, in, in_bytes);
+    memcpy(aux_copy, aux, shape.aux_bytes);
+    kernelReference(family, M, N, in, aux, out_targ);
+
+    __roi_begin();
+    kernel_list[k].func_ptr(M, N, in, shape.aux_bytes > 0 ? aux : NULL, out);
+    __roi_end();
+
+    if (memcmp(out, out_targ, shape.out_elems * sizeof(double)) != 0) {
+        for (i = 0; i < shape.out_elems; i++) {
+            if (out[i] != out_targ[i]) {
+                fprintf(stderr,
+                        "Validation failed on kernel %d! Expected %.3f but "
+                        "got %.3f at out[%zd]\n",
+                        k, out_targ[i], out[i], i);
+                return false;
+            }
+        }
+    }
+
+    /* Look for changes to the inputs */
+    if (memcmp(in, in_copy, in_bytes) != 0 ||
+        memcmp(aux, aux_copy, shape.aux_bytes) != 0) {
+        fprintf(stderr, "Validation failed on kernel %d! Input corrupted\n",
+                k);
+        return false;
+    }
+
+    /* Look for out of bounds writes past out */
+    i = first_nonzero(&out[shape.out_elems], out_elems - shape.out_elems);
+    if (i < out_elems - shape.out_elems) {
+        fprintf(stderr,
+                "Validation failed on kernel %d! Out-of-bounds write to "
+                "out[%zd]\n",
+                k, shape.out_elems + i);
+        return false;
+    }
     return true;
 }
 
 static void usage(char *cmd) {
-    fprintf(stderr, "Usage: %s [-h] [-M M] [-N N] [-F ID]\n", cmd);
+    fprintf(stderr,
+            "Usage: %s [-h] [-M M] [-N N] [-F ID | -k ID | -C config] "
+            "[-A bytes] [-T bytes] [-B bytes] [-G bytes] [-H]\n",
+            cmd);
     fprintf(stderr, "  -N N    Set number of rows of A / cols of B\n");
     fprintf(stderr, "  -M M    Set number of cols of A / rows of B\n");
     fprintf(stderr, "  -F ID   Run function number ID\n");
+    fprintf(stderr, "  -k ID   Run kernel number ID of kernels.c instead\n");
+    fprintf(stderr, "  -C rows,cols,order,diag\n");
+    fprintf(stderr, "          Run trans_tuned() with this tiling instead, "
+                    "as tune-trans does\n");
+    fprintf(stderr, "  -A, -T, -B bytes\n");
+    fprintf(stderr, "          Move A, tmp or B up by a multiple of 8 bytes\n");
+    fprintf(stderr, "  -G bytes\n");
+    fprintf(stderr, "          Pack the matrices, with a gap (a multiple of "
+                    "8) between them\n");
+    fprintf(stderr, "  -H      Map the matrices with explicit huge pages\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "The generated trace file is written to default.trace "
                     "by default, but a\n");
@@ -111,7 +495,11 @@ int entry(int argc, char *argv[]) {
 
     int c;
     int selectedFunc = -1;
-    while ((c = getopt(argc, argv, "hvM:N:F:")) != -1) {
+    int selectedKernel = -1;
+    bool tuned = false;
+    tune_config_t config;
+    long offsets[3] = {0, 0, 0};
+    while ((c = getopt(argc, argv, "hvHM:N:F:k:C:A:T:B:G:")) != -1) {
         switch (c) {
         case 'M':
             M = (size_t)atoi(optarg);
@@ -119,9 +507,35 @@ int entry(int argc, char *argv[]) {
         case 'N':
             N = (size_t)atoi(optarg);
             break;
+        case 'A':
+            offsets[0] = atol(optarg);
+            break;
+        case 'T':
+            offsets[1] = atol(optarg);
+            break;
+        case 'B':
+            offsets[2] = atol(optarg);
+            break;
+        case 'G':
+            gap = atol(optarg);
+            break;
+        case 'H':
+            huge = true;
+            break;
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'k':
+            selectedKernel = atoi(optarg);
+            break;
+        case 'C':
+            if (!parse_tune_config(optarg, &config)) {
+                fprintf(stderr, "Error: invalid tile configuration '%s'\n",
+                        optarg);
+                exit(1);
+            }
+            tuned = true;
+            break;
         case 'v':
             break;
         case 'h':
@@ -138,6 +552,25 @@ int entry(int argc, char *argv[]) {
         exit(1);
     }
 
+    for (i = 0; i < 3; i++) {
+        if (offsets[i] < 0 || (size_t)offsets[i] > MAX_PLACEMENT ||
+            offsets[i] % 8 != 0) {
+            fprintf(stderr,
+                    "Error: offsets must be multiples of 8 in [0, %zu]\n",
+                    MAX_PLACEMENT);
+            exit(1);
+        }
+    }
+    if (gap < -1 ||
+        (gap >= 0 && ((size_t)gap > MAX_PLACEMENT || gap % 8 != 0))) {
+        fprintf(stderr, "Error: the gap must be a multiple of 8 in [0, %zu]\n",
+                MAX_PLACEMENT);
+        exit(1);
+    }
+    offset_a = (size_t)offsets[0];
+    offset_t = (size_t)offsets[1];
+    offset_b = (size_t)offsets[2];
+
     if (signal(SIGALRM, sigalrm_handler) == SIG_ERR) {
         fprintf(stderr, "Unable to install SIGALRM handler\n");
         exit(1);
@@ -146,39 +579,43 @@ int entry(int argc, char *argv[]) {
     /* Time out and give up after a while */
     alarm(360);
 
+    /* Kernels other than transpose are run on their own */
+    if (selectedKernel != -1) {
+        registerKernels();
+        if (selectedKernel < 0 || selectedKernel >= kernel_counter) {
+            fprintf(stderr, "Error: there is no kernel %d\n", selectedKernel);
+            exit(1);
+        }
+        return trace_kernel(selectedKernel) ? 0 : 1;
+    }
+
+    /* The CT runtime records one trace for all threads, interleaved in no
+     * fixed order, so multithreaded functions are traced on one thread */
+    setenv(TRANS_THREADS_ENV, "1", 1);
+
     /*  Register transpose functions */
     registerFunctions();
 
-    /* Clear out matrices */
-    memset(bigA, 0, sizeof(bigA));
-    memset(bigB, 0, sizeof(bigB));
+    /* Map the matrices, which start out cleared */
+    allocate();
 
-    /* Fill A with data */
-    initMatrix(M, N, bigA, bigB);
-    /* Make copy of A */
-    memset(bigAcopy, 0, sizeof(bigAcopy));
-    copyMatrix(M, N, bigAcopy, bigA);
-    /* Generate target version */
-    memset(bigBtarg, 0, sizeof(bigBtarg));
-    correctTrans(M, N, bigA, bigBtarg);
+    if (tuned) {
+        if (tuned_func == NULL) {
+            fprintf(stderr, "Error: trans.c registers no tuned function\n");
+            exit(1);
+        }
+        return trace_tuned(&config) ? 0 : 1;
+    }
 
     if (-1 == selectedFunc) {
         /* Invoke registered transpose functions */
         for (i = 0; i < func_counter; i++) {
-            memset(bigT, 0, sizeof(bigT));
-            __roi_begin();
-            (*func_list[i].func_ptr)(M, N, bigA, bigB, bigT);
-            __roi_end();
-            if (!validate(i, bigA, bigAcopy, bigB, bigBtarg)) {
+            if (!trace_func(i)) {
                 return i + 1;
             }
         }
     } else {
-        memset(bigT, 0, sizeof(bigT));
-        __roi_begin();
-        (*func_list[selectedFunc].func_ptr)(M, N, bigA, bigB, bigT);
-        __roi_end();
-        if (!validate(selectedFunc, bigA, bigAcopy, bigB, bigBtarg)) {
+        if (!trace_func(selectedFunc)) {
             return 1;
         }
     }
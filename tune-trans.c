@@ -0,0 +1,600 @@
+/**
+ * @file tune-trans.c
+ * @brief Searches tile configurations for trans_tuned() in trans.c
+ *
+ * For each matrix size, this program enumerates tile shapes, loop orders and
+ * diagonal strategies, replays the accesses trans_tuned() would make for
+ * each of them through the in-process cache simulator, on both the test
+ * cache and the Haswell L1 cache, and keeps the configuration with the
+ * fewest cycles on the cache the size is graded on. The configuration picked
+ * for each size is then traced for real through tracegen-ct, which runs
+ * trans_tuned() from trans.c, and the run fails if the replay disagrees with
+ * that trace. With -t, every configuration is ranked on such traces instead.
+ *
+ * The winners are printed as the tuned_config() dispatch function that
+ * transpose_submit() consumes, and with -w replace the generated block of
+ * trans.c directly.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "cachelab.h"
+
+#define MAX_STR 1024 /* Max string size */
+
+/** @brief File tracegen-ct writes the traces of trans_tuned() to */
+#define TRACE_FILE "trace.tune"
+
+/** @brief Maximum number of sizes tuned in one run */
+#define MAX_TARGETS 32
+
+/** @brief Markers around the generated block of trans.c */
+#define DISPATCH_BEGIN "/* BEGIN TUNED DISPATCH"
+#define DISPATCH_END "/* END TUNED DISPATCH */"
+
+/** @brief Tile sides tried for both the rows and the columns */
+static const size_t TILE_SIDES[] = {4, 8, 16, 32, 64};
+#define NUM_SIDES (sizeof(TILE_SIDES) / sizeof(TILE_SIDES[0]))
+
+/**
+ * @brief Addresses of A, tmp and B, in the order tracegen-ct declares them
+ *
+ * Only the offsets matter to the simulated sets, and all three arrays start
+ * on a cache block boundary, so this matches the layout of the real traces.
+ */
+#define BASE_A 0x100000000000UL
+#define BASE_T (BASE_A + (unsigned long)MAXN * MAXN * sizeof(double))
+#define BASE_B (BASE_T + TMPCOUNT * sizeof(double))
+
+/** @brief Caches a configuration is simulated on */
+enum { CACHE_TEST, CACHE_HASWELL, NUM_CACHES };
+
+static const char *const CACHE_NAMES[NUM_CACHES] = {"test", "haswell"};
+
+/** @brief Sets, associativity and block bits of each cache */
+static const unsigned int CACHE_GEOMETRY[NUM_CACHES][3] = {
+    {TEST_LOG_SET, TEST_ASSOC, TEST_LOG_BLOCK},
+    {HASWELL_L1_SET, HASWELL_L1_ASSOC, HASWELL_L1_BLOCK},
+};
+
+static const char *const ORDER_NAMES[] = {"TUNE_ORDER_ROWS",
+                                          "TUNE_ORDER_COLS"};
+
+static const char *const DIAG_NAMES[] = {"TUNE_DIAG_NONE", "TUNE_DIAG_DEFER",
+                                         "TUNE_DIAG_BUFFER"};
+
+/** @brief A matrix size to tune, and the cache it is ranked on */
+typedef struct {
+    size_t M;
+    size_t N;
+    int cache;
+} tune_target_t;
+
+/** @brief Simulated performance of one configuration */
+typedef struct {
+    tune_config_t config;
+    csim_stats_t stats[NUM_CACHES];
+} tune_result_t;
+
+/* Sizes tuned when none are given, as graded by driver.py */
+static const char *const DEFAULT_TARGETS[] = {"32x32@test",
+                                              "1024x1024@haswell"};
+
+/**
+ * @brief Returns the cycles charged for a simulation, as test-trans does
+ */
+static unsigned long get_cycles(const csim_stats_t *stats) {
+    return HIT_CYCLES * stats->hits + MISS_CYCLES * stats->misses;
+}
+
+/**
+ * @brief Simulates one access on every cache
+ */
+static void touch(cache_sim_t sims[NUM_CACHES], char op, unsigned long addr) {
+    for (int c = 0; c < NUM_CACHES; c++) {
+        cacheSimAccess(&sims[c], op, addr);
+    }
+}
+
+/**
+ * @brief Simulates B[j][i] = A[i][j]
+ */
+static void copy_element(cache_sim_t sims[NUM_CACHES], size_t M, size_t N,
+                         size_t i, size_t j) {
+    touch(sims, 'L', BASE_A + (i * M + j) * sizeof(double));
+    touch(sims, 'S', BASE_B + (j * N + i) * sizeof(double));
+}
+
+/**
+ * @brief Replays the accesses of trans_tuned() in trans.c
+ *
+ * The loops below must stay in sync with that function.
+ */
+static void replay(cache_sim_t sims[NUM_CACHES], size_t M, size_t N,
+                   const tune_config_t *config) {
+    size_t rows = config->rows;
+    size_t cols = config->cols;
+
+    for (size_t i0 = 0; i0 < N; i0 += rows) {
+        for (size_t j0 = 0; j0 < M; j0 += cols) {
+            size_t i1 = i0 + rows < N ? i0 + rows : N;
+            size_t j1 = j0 + cols < M ? j0 + cols : M;
+            bool on_diag = i0 < j1 && j0 < i1;
+            bool defer = on_diag && config->diag == TUNE_DIAG_DEFER;
+
+            if (on_diag && config->diag == TUNE_DIAG_BUFFER) {
+                for (size_t i = i0; i < i1; i++) {
+                    for (size_t j = j0; j < j1; j++) {
+                        touch(sims, 'L', BASE_A + (i * M + j) * sizeof(double));
+                        touch(sims, 'S', BASE_T + (j - j0) * sizeof(double));
+                    }
+                    for (size_t j = j0; j < j1; j++) {
+                        touch(sims, 'L', BASE_T + (j - j0) * sizeof(double));
+                        touch(sims, 'S', BASE_B + (j * N + i) * sizeof(double));
+                    }
+                }
+            } else if (config->order == TUNE_ORDER_ROWS) {
+                for (size_t i = i0; i < i1; i++) {
+                    for (size_t j = j0; j < j1; j++) {
+                        if (!defer || i != j) {
+                            copy_element(sims, M, N, i, j);
+                        }
+                    }
+                    if (defer && i >= j0 && i < j1) {
+                        copy_element(sims, M, N, i, i);
+                    }
+                }
+            } else {
+                for (size_t j = j0; j < j1; j++) {
+                    for (size_t i = i0; i < i1; i++) {
+                        if (!defer || i != j) {
+                            copy_element(sims, M, N, i, j);
+                        }
+                    }
+                    if (defer && j >= i0 && j < i1) {
+                        copy_element(sims, M, N, j, j);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Has tracegen-ct trace trans_tuned() with one configuration
+ *
+ * tracegen-ct -C runs trans_tuned() on its own, and validates its result.
+ *
+ * @return True if the trace was written to TRACE_FILE, false otherwise
+ */
+static bool generate_trace(size_t M, size_t N, const tune_config_t *config) {
+    char cmd[MAX_STR];
+    snprintf(cmd, sizeof(cmd),
+             "CONTECH_TRACE=%s ./tracegen-ct -M %zu -N %zu -C %zu,%zu,%d,%d",
+             TRACE_FILE, M, N, config->rows, config->cols, (int)config->order,
+             (int)config->diag);
+
+    int status = system(cmd);
+    if (status < 0) {
+        printf("Failed to run tracegen-ct: %s\n", strerror(errno));
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Error: tracegen-ct failed (status %x)\n", status);
+        printf("Command run: %s\n", cmd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Simulates TRACE_FILE on every cache
+ *
+ * @return True on success, false otherwise
+ */
+static bool simulate_trace(cache_sim_t sims[NUM_CACHES]) {
+    FILE *fp = fopen(TRACE_FILE, "r");
+    if (fp == NULL) {
+        printf("Failed to open %s: %s\n", TRACE_FILE, strerror(errno));
+        return false;
+    }
+
+    bool success = true;
+    for (int c = 0; success && c < NUM_CACHES; c++) {
+        rewind(fp);
+        success = cacheSimTrace(&sims[c], fp);
+    }
+    fclose(fp);
+    if (!success) {
+        printf("Error: the trace of trans_tuned() could not be parsed\n");
+    }
+    return success;
+}
+
+/**
+ * @brief Simulates one configuration on every cache
+ *
+ * @param[in]     M, N    Size of the transpose
+ * @param[in,out] result  The configuration, and its simulated performance
+ * @param[in]     traced  Trace trans_tuned() instead of replaying it
+ *
+ * @return True on success, false otherwise
+ */
+static bool evaluate(size_t M, size_t N, tune_result_t *result, bool traced) {
+    cache_sim_t sims[NUM_CACHES];
+
+    for (int c = 0; c < NUM_CACHES; c++) {
+        if (!cacheSimInit(&sims[c], CACHE_GEOMETRY[c][0], CACHE_GEOMETRY[c][1],
+                          CACHE_GEOMETRY[c][2])) {
+            for (int k = 0; k < c; k++) {
+                cacheSimFree(&sims[k]);
+            }
+            return false;
+        }
+    }
+
+    bool success = true;
+    if (traced) {
+        success = generate_trace(M, N, &result->config) &&
+                  simulate_trace(sims);
+        (void)remove(TRACE_FILE);
+    } else {
+        replay(sims, M, N, &result->config);
+    }
+
+    for (int c = 0; c < NUM_CACHES; c++) {
+        result->stats[c] = sims[c].stats;
+        cacheSimFree(&sims[c]);
+    }
+    return success;
+}
+
+/**
+ * @brief Checks the replay of the picked configuration against a trace
+ *
+ * @return True if both agree on every cache, false otherwise
+ */
+static bool check_replay(const tune_target_t *target,
+                         const tune_result_t *best) {
+    tune_result_t traced;
+    traced.config = best->config;
+
+    printf("Checking the replay against a trace of trans_tuned()\n");
+    if (!evaluate(target->M, target->N, &traced, true)) {
+        return false;
+    }
+
+    bool same = true;
+    for (int c = 0; c < NUM_CACHES; c++) {
+        const csim_stats_t *r = &best->stats[c];
+        const csim_stats_t *t = &traced.stats[c];
+        if (r->hits != t->hits || r->misses != t->misses ||
+            r->evictions != t->evictions) {
+            printf("Error: on the %s cache, the replay has hits:%lu "
+                   "misses:%lu evictions:%lu but the trace hits:%lu "
+                   "misses:%lu evictions:%lu\n",
+                   CACHE_NAMES[c], r->hits, r->misses, r->evictions, t->hits,
+                   t->misses, t->evictions);
+            same = false;
+        }
+    }
+    if (!same) {
+        printf("replay() in tune-trans.c is out of sync with trans_tuned() "
+               "in trans.c\n");
+    }
+    return same;
+}
+
+/**
+ * @brief Returns true if a ranks before b on the given cache
+ *
+ * Ties are broken on the other cache, then in favor of the configuration
+ * enumerated first.
+ */
+static bool is_better(const tune_result_t *a, const tune_result_t *b,
+                      int cache) {
+    unsigned long a_cycles = get_cycles(&a->stats[cache]);
+    unsigned long b_cycles = get_cycles(&b->stats[cache]);
+    if (a_cycles != b_cycles) {
+        return a_cycles < b_cycles;
+    }
+    return get_cycles(&a->stats[1 - cache]) < get_cycles(&b->stats[1 - cache]);
+}
+
+/**
+ * @brief Prints one configuration and its simulated performance
+ */
+static void print_result(const tune_result_t *result) {
+    printf("  %3zux%-3zu %-15s %-16s", result->config.rows,
+           result->config.cols, ORDER_NAMES[result->config.order],
+           DIAG_NAMES[result->config.diag]);
+    for (int c = 0; c < NUM_CACHES; c++) {
+        printf("  %s: %8lu misses %10lu cycles", CACHE_NAMES[c],
+               result->stats[c].misses, get_cycles(&result->stats[c]));
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Searches every configuration for one size
+ *
+ * @param[in]  target   The size to tune
+ * @param[in]  verbose  Print every configuration, not just the best one
+ * @param[in]  traced   Rank on traces of trans_tuned() instead of replays
+ * @param[out] best     The best configuration found
+ *
+ * @return True on success, false otherwise
+ */
+static bool tune(const tune_target_t *target, bool verbose, bool traced,
+                 tune_result_t *best) {
+    bool found = false;
+
+    printf("%zux%zu, ranked on the %s cache:\n", target->M, target->N,
+           CACHE_NAMES[target->cache]);
+
+    for (size_t r = 0; r < NUM_SIDES; r++) {
+        for (size_t c = 0; c < NUM_SIDES; c++) {
+            for (int order = TUNE_ORDER_ROWS; order <= TUNE_ORDER_COLS;
+                 order++) {
+                for (int diag = TUNE_DIAG_NONE; diag <= TUNE_DIAG_BUFFER;
+                     diag++) {
+                    /* Buffered tiles are always walked along the rows */
+                    if (diag == TUNE_DIAG_BUFFER && order != TUNE_ORDER_ROWS) {
+                        continue;
+                    }
+
+                    tune_result_t result;
+                    result.config.rows = TILE_SIDES[r];
+                    result.config.cols = TILE_SIDES[c];
+                    result.config.order = (tune_order_t)order;
+                    result.config.diag = (tune_diag_t)diag;
+                    if (!evaluate(target->M, target->N, &result, traced)) {
+                        return false;
+                    }
+                    if (verbose) {
+                        print_result(&result);
+                    }
+                    if (!found || is_better(&result, best, target->cache)) {
+                        *best = result;
+                        found = true;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Best:\n");
+    print_result(best);
+    return true;
+}
+
+/**
+ * @brief Writes the generated tuned_config() function
+ */
+static void write_dispatch(FILE *fp, const tune_target_t *targets,
+                           const tune_result_t *best, int ntargets) {
+    fprintf(fp, "%s: generated by tune-trans, do not edit */\n",
+            DISPATCH_BEGIN);
+    fprintf(fp,
+            "/**\n"
+            " * @brief Returns the configuration tune-trans picked for an M x "
+            "N transpose.\n"
+            " *\n"
+            " * @return The configuration, with zero rows if the size was not "
+            "tuned\n"
+            " */\n"
+            "static tune_config_t tuned_config(size_t M, size_t N) {\n"
+            "    tune_config_t config = {0, 0, TUNE_ORDER_ROWS, "
+            "TUNE_DIAG_NONE};\n");
+    for (int t = 0; t < ntargets; t++) {
+        const tune_config_t *config = &best[t].config;
+        int cache = targets[t].cache;
+        fprintf(fp, "    %sif (M == %zu && N == %zu) {\n",
+                t > 0 ? "} else " : "", targets[t].M, targets[t].N);
+        fprintf(fp, "        /* %lu misses, %lu cycles on the %s cache */\n",
+                best[t].stats[cache].misses,
+                get_cycles(&best[t].stats[cache]), CACHE_NAMES[cache]);
+        fprintf(fp, "        config = (tune_config_t){%zu, %zu, %s, %s};\n",
+                config->rows, config->cols, ORDER_NAMES[config->order],
+                DIAG_NAMES[config->diag]);
+    }
+    if (ntargets > 0) {
+        fprintf(fp, "    }\n");
+    }
+    fprintf(fp, "    return config;\n}\n%s\n", DISPATCH_END);
+}
+
+/**
+ * @brief Replaces the generated block of a source file
+ *
+ * @return True on success, false otherwise
+ */
+static bool rewrite_source(const char *file_name, const tune_target_t *targets,
+                           const tune_result_t *best, int ntargets) {
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: cannot open %s\n", file_name);
+        return false;
+    }
+
+    /* Read the whole file */
+    size_t size = 0;
+    size_t cap = 1 << 16;
+    char *text = malloc(cap);
+    size_t got;
+    while (text != NULL &&
+           (got = fread(text + size, 1, cap - size - 1, fp)) > 0) {
+        size += got;
+        if (size + 1 == cap) {
+            char *grown = realloc(text, cap * 2);
+            if (grown == NULL) {
+                free(text);
+            }
+            text = grown;
+            cap *= 2;
+        }
+    }
+    fclose(fp);
+    if (text == NULL) {
+        fprintf(stderr, "Error: out of memory reading %s\n", file_name);
+        return false;
+    }
+    text[size] = '\0';
+
+    char *begin = strstr(text, DISPATCH_BEGIN);
+    char *end = begin != NULL ? strstr(begin, DISPATCH_END) : NULL;
+    if (end == NULL) {
+        fprintf(stderr, "Error: %s has no generated dispatch block\n",
+                file_name);
+        free(text);
+        return false;
+    }
+    end += strlen(DISPATCH_END);
+    if (*end == '\n') {
+        end++;
+    }
+
+    /* Write the new file next to the old one, then replace it */
+    char tmp_name[MAX_STR];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tune", file_name);
+    fp = fopen(tmp_name, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: cannot create %s\n", tmp_name);
+        free(text);
+        return false;
+    }
+    fwrite(text, 1, (size_t)(begin - text), fp);
+    write_dispatch(fp, targets, best, ntargets);
+    fputs(end, fp);
+    free(text);
+    if (fclose(fp) != 0 || rename(tmp_name, file_name) != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", file_name);
+        remove(tmp_name);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a size of the form MxN, optionally followed by @test or
+ *        @haswell to pick the cache it is ranked on
+ *
+ * @return True on success, false otherwise
+ */
+static bool parse_target(const char *spec, tune_target_t *target) {
+    char cache[MAX_STR] = "test";
+    int consumed = 0;
+
+    if (sscanf(spec, "%zux%zu%n", &target->M, &target->N, &consumed) != 2) {
+        return false;
+    }
+    if (spec[consumed] == '@') {
+        snprintf(cache, sizeof(cache), "%s", spec + consumed + 1);
+    } else if (spec[consumed] != '\0') {
+        return false;
+    }
+
+    for (target->cache = 0; target->cache < NUM_CACHES; target->cache++) {
+        if (strcmp(cache, CACHE_NAMES[target->cache]) == 0) {
+            break;
+        }
+    }
+    return target->cache < NUM_CACHES && target->M > 0 && target->N > 0 &&
+           target->M <= MAXN && target->N <= MAXN;
+}
+
+/*
+ * usage - Prints usage info
+ */
+static void usage(char *argv[]) {
+    printf("Usage: %s [-h] [-v] [-t] [-w <file>] [MxN[@test|@haswell] ...]\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -t          Rank on traces of trans_tuned() (slow)\n");
+    printf("  -v          Print every configuration tried\n");
+    printf("  -w <file>   Replace the generated dispatch block of <file>\n");
+    printf("Sizes are ranked on the test cache unless @haswell is given.\n");
+    printf("Without sizes, tunes 32x32@test and 1024x1024@haswell.\n");
+    printf("Example: %s -w trans.c 32x32 1024x1024@haswell\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[]) {
+    bool verbose = false;
+    bool traced = false;
+    const char *out_file = NULL;
+    tune_target_t targets[MAX_TARGETS];
+    tune_result_t best[MAX_TARGETS];
+    int ntargets = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hvtw:")) != -1) {
+        switch (c) {
+        case 't':
+            traced = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'w':
+            out_file = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    int nspecs = argc - optind;
+    const char *const *specs = (const char *const *)&argv[optind];
+    if (nspecs == 0) {
+        nspecs = sizeof(DEFAULT_TARGETS) / sizeof(DEFAULT_TARGETS[0]);
+        specs = DEFAULT_TARGETS;
+    }
+    if (nspecs > MAX_TARGETS) {
+        printf("Error: at most %d sizes can be tuned at once\n", MAX_TARGETS);
+        exit(1);
+    }
+
+    for (int i = 0; i < nspecs; i++) {
+        if (!parse_target(specs[i], &targets[ntargets])) {
+            printf("Error: invalid size '%s'\n", specs[i]);
+            usage(argv);
+            exit(1);
+        }
+        ntargets++;
+    }
+
+    for (int t = 0; t < ntargets; t++) {
+        if (!tune(&targets[t], verbose, traced, &best[t])) {
+            exit(1);
+        }
+        if (!traced && !check_replay(&targets[t], &best[t])) {
+            exit(1);
+        }
+        printf("\n");
+    }
+
+    if (out_file != NULL) {
+        if (!rewrite_source(out_file, targets, best, ntargets)) {
+            exit(1);
+        }
+        printf("Updated the tuned dispatch of %s\n", out_file);
+    } else {
+        write_dispatch(stdout, targets, best, ntargets);
+    }
+
+    return 0;
+}